@@ -0,0 +1,431 @@
+/*!
+	\class Diamondek::Benchmarks
+    \brief Benchmarks class
+
+    Microbenchmarks of collision, explosion, level loading and simulation tick hot paths.
+    Build with "make -C bench" (see bench/Makefile), it is built from the game sources without main.cpp.
+    Run from the game directory (it reads files from data/), e.g. "make -C bench run", optionally with "--json", "--filter <substring>" and "--min-time <msec>".
+    Synthetic level images and levels file are written to the temporary directory (TMPDIR, TMP or TEMP) and removed when benchmarks end.
+    Shipped levels are loaded from the level pack if there is one (level_load/levelN) and from levels.json and images (level_load/json/levelN).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "board.h"
+
+#define BENCH_MIN_TIME_MSEC_DEFAULT 200
+#define BENCH_SYNTHETIC_SIZE_X 2048
+#define BENCH_SYNTHETIC_SIZE_Y 2048
+#define BENCH_SYNTHETIC_HOLE_STEP 64
+#define BENCH_SYNTHETIC_LEVEL "diamondek_bench_level.png"
+#define BENCH_SYNTHETIC_DENSITY "diamondek_bench_level_density.png"
+#define BENCH_SYNTHETIC_LEVELS "diamondek_bench_levels.json"
+// Temporary directory, if none of TMPDIR, TMP, TEMP is set
+#define BENCH_TEMP_DIR_DEFAULT "/tmp"
+#define BENCH_TICKS_PER_BATCH 2000
+#define BENCH_POINT_SCAN_STEP 4
+// Benchmark stops after this many times of min time, even if operations took less (setUp() is slow)
+#define BENCH_MAX_WALL_FACTOR 5
+
+namespace Diamondek {
+
+/// Sink for results of benchmarked calls, so compiler can't drop them
+static volatile uint32_t benchSink;
+
+/// One benchmark. Only run() is timed. Operations numbered 0..batchLimit()-1 are run after each setUp()
+class BenchCase
+{
+public:
+	explicit BenchCase(const std::string& caseName) : name(caseName) {};
+	virtual ~BenchCase() {};
+	/// Prepare state for the following operations
+	virtual void setUp() {};
+	/// Run operation number 'i' of the batch
+	virtual void run(uint32_t i) = 0;
+	/// Max number of operations, before setUp() must be called again (0 - unlimited)
+	virtual uint32_t batchLimit() { return 0; };
+	std::string name;
+};
+
+class Benchmarks
+{
+public:
+	Benchmarks(uint32_t minTimeMsec, const std::string& filter);
+	~Benchmarks() { _removeSyntheticLevel(); };
+	/// Run all benchmarks matching the filter, print results as text or JSON
+	void runAll(bool json);
+
+	/// Private Board hot paths
+	static bool loadLevel(Board& board, int levelNum) { return board.loadLevelData(levelNum); };
+	static void applyExplosion(Board& board, CollisionData* collisionData, float radius) { board._applyExplosion(collisionData, radius); };
+	/// Return ID of the first destructible spritex of the board, or ENTITY_NONE
+	static uint32_t findDestructible(Board& board);
+private:
+	/// Run 'bench' at least _minTimeMsec, return nanoseconds per operation and number of operations in 'ops'
+	double _measure(BenchCase& bench, uint32_t& ops);
+	/// Write synthetic large level images and levels file
+	void _writeSyntheticLevel();
+	/// Remove files written by _writeSyntheticLevel
+	void _removeSyntheticLevel();
+	/// Return path of file 'name' in the temporary directory
+	static std::string _tempPath(const std::string& name);
+
+	uint32_t _minTimeMsec;
+	std::string _filter;
+	/// Paths of synthetic level files
+	std::string _levelImage, _levelDensity, _levelsFile;
+};
+
+/// Spritex::collides of spritex 'a' at 'posA' with 'b' at 'posB'
+class CollideBench : public BenchCase
+{
+public:
+	CollideBench(const std::string& caseName, Spritex* a, Spritex* b, const sf::Vector2f& posA, const sf::Vector2f& posB, bool pp)
+		: BenchCase(caseName), _a(a), _b(b), _posA(posA), _posB(posB), _pp(pp) {};
+	virtual void setUp() { _a->setPosition(_posA); _b->setPosition(_posB); };
+	virtual void run(uint32_t) { benchSink = _a->collides(*_b, _pp, false, &_cp); };
+private:
+	Spritex* _a;
+	Spritex* _b;
+	sf::Vector2f _posA, _posB, _cp;
+	bool _pp;
+};
+
+/// Spritex::collides in remove mode of spritex 'a' with freshly loaded destructible level. Every operation hits untouched pixels
+class CollideRemoveBench : public BenchCase
+{
+public:
+	CollideRemoveBench(const std::string& caseName, Spritex* a, const std::string& image, const std::string& density)
+		: BenchCase(caseName), _a(a), _level(NULL), _image(image), _density(density) {};
+	virtual ~CollideRemoveBench() { delete _level; };
+	virtual void setUp();
+	virtual void run(uint32_t i) { _a->setPosition(_positions[i]); benchSink = _a->collides(*_level, true, true, NULL); };
+	virtual uint32_t batchLimit() { return static_cast<uint32_t>(_positions.size()); };
+private:
+	Spritex* _a;
+	Spritex* _level;
+	std::string _image, _density;
+	std::vector<sf::Vector2f> _positions;
+};
+
+/// Board::_applyExplosion with radius 'radius' at solid points of level 'levelNum'. Every operation hits untouched pixels
+class ExplosionBench : public BenchCase
+{
+public:
+	ExplosionBench(const std::string& caseName, Board& board, int levelNum, float radius)
+		: BenchCase(caseName), _board(board), _levelNum(levelNum), _radius(radius) {};
+	virtual void setUp();
+	virtual void run(uint32_t i) { _cd.collisionPoint = _points[i]; Benchmarks::applyExplosion(_board, &_cd, _radius); };
+	virtual uint32_t batchLimit() { return static_cast<uint32_t>(_points.size()); };
+private:
+	Board& _board;
+	int _levelNum;
+	float _radius;
+	CollisionData _cd;
+	std::vector<sf::Vector2f> _points;
+};
+
+/// Board::loadLevelData of level 'levelNum'
+class LevelLoadBench : public BenchCase
+{
+public:
+	LevelLoadBench(const std::string& caseName, Board& board, int levelNum) : BenchCase(caseName), _board(board), _levelNum(levelNum) {};
+	virtual void run(uint32_t) { benchSink = Benchmarks::loadLevel(_board, _levelNum); };
+private:
+	Board& _board;
+	int _levelNum;
+};
+
+/// Board::tick (input, movement and processSpritexes) of level 'levelNum', with ball launched at once
+class TickBench : public BenchCase
+{
+public:
+	TickBench(const std::string& caseName, Board& board, int levelNum) : BenchCase(caseName), _board(board), _levelNum(levelNum) {};
+	virtual void setUp() { _board.setSeed(RNG_SEED_DEFAULT); _board.runHeadless(_levelNum, 0, _script); };
+	virtual void run(uint32_t) { _board.tick(inLaunch); };
+	virtual uint32_t batchLimit() { return BENCH_TICKS_PER_BATCH; };
+private:
+	Board& _board;
+	int _levelNum;
+	InputScript _script;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void CollideRemoveBench::setUp()
+{
+	delete _level;
+	_level = new Spritex(_image, _density);
+	_positions.clear();
+	// Non overlapping positions of 'a' over solid pixels of the level
+	sf::Vector2f size = _a->getSize();
+	for (float y = 0; y + size.y <= _level->getSize().y; y += size.y)
+		for (float x = 0; x + size.x <= _level->getSize().x; x += size.x)
+		{
+			if (_level->getDensityAt(static_cast<int>(x + size.x / 2), static_cast<int>(y + size.y / 2)) > 0) _positions.push_back(sf::Vector2f(x, y));
+		};
+	if (_positions.empty()) throw "Error: no solid pixels in " + _image;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ExplosionBench::setUp()
+{
+	if (!Benchmarks::loadLevel(_board, _levelNum)) throw "Error loading level for explosion benchmark";
+	_cd.collisioneeID = Benchmarks::findDestructible(_board);
+	_cd.collisionee = _board.getSpritex(_cd.collisioneeID);
+	if (!_cd.collisionee) throw "Error: no destructible spritex on level";
+	_points.clear();
+	// Explosions destroy radius/2 around epicentre, so take one solid epicentre per 'radius' sized cell to hit mostly untouched pixels
+	sf::Vector2f size = _cd.collisionee->getSize();
+	sf::Vector2f origin = _cd.collisionee->getPosition();
+	int cell = static_cast<int>(_radius);
+	for (int cy = 0; cy < static_cast<int>(size.y); cy += cell)
+		for (int cx = 0; cx < static_cast<int>(size.x); cx += cell)
+		{
+			bool found = false;
+			for (int y = cy; (y < cy + cell) && (y < static_cast<int>(size.y)) && !found; y += BENCH_POINT_SCAN_STEP)
+				for (int x = cx; (x < cx + cell) && (x < static_cast<int>(size.x)) && !found; x += BENCH_POINT_SCAN_STEP)
+				{
+					if (_cd.collisionee->getDensityAt(x, y) == 0) continue;
+					_points.push_back(origin + sf::Vector2f(static_cast<float>(x), static_cast<float>(y)));
+					found = true;
+				};
+		};
+	if (_points.empty()) throw "Error: no solid pixels on level for explosion benchmark";
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Benchmarks::Benchmarks(uint32_t minTimeMsec, const std::string& filter) : _minTimeMsec(minTimeMsec), _filter(filter)
+{
+	_levelImage = _tempPath(BENCH_SYNTHETIC_LEVEL);
+	_levelDensity = _tempPath(BENCH_SYNTHETIC_DENSITY);
+	_levelsFile = _tempPath(BENCH_SYNTHETIC_LEVELS);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::string Benchmarks::_tempPath(const std::string& name)
+{
+	const char* vars[] = { "TMPDIR", "TMP", "TEMP" };
+	std::string dir = BENCH_TEMP_DIR_DEFAULT;
+	for (size_t i = 0; i < sizeof(vars) / sizeof(vars[0]); i++)
+	{
+		if ((getenv(vars[i]) == NULL) || (*getenv(vars[i]) == 0)) continue;
+		dir = getenv(vars[i]);
+		break;
+	};
+	// Path goes to levels file as is, so it must not have JSON escapes. Windows accepts '/' as well
+	std::replace(dir.begin(), dir.end(), '\\', '/');
+	if (dir[dir.size() - 1] != '/') dir += '/';
+	return dir + name;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t Benchmarks::findDestructible(Board& board)
+{
+	for (int i = 0; i < board._entities.size(); i++)
+	{
+		if (board._entities.isDestructible(i)) return board._entities.getID(i);
+	};
+	return ENTITY_NONE;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+double Benchmarks::_measure(BenchCase& bench, uint32_t& ops)
+{
+	typedef std::chrono::steady_clock clock;
+	const std::chrono::nanoseconds minTime = std::chrono::milliseconds(_minTimeMsec);
+	std::chrono::nanoseconds elapsed(0);
+	clock::time_point wallStart = clock::now();
+	uint32_t batch = 1;
+	uint32_t available = 0; // operations left before the next setUp()
+	uint32_t cursor = 0; // next operation number after the last setUp()
+	uint32_t done, chunk;
+
+	ops = 0;
+	// Double batch size until enough time is measured. setUp() is called only when the case runs out of prepared state, and is not measured
+	while ((elapsed < minTime) && (clock::now() - wallStart < minTime * BENCH_MAX_WALL_FACTOR))
+	{
+		for (done = 0; done < batch; done += chunk)
+		{
+			if (available == 0)
+			{
+				bench.setUp();
+				available = bench.batchLimit() ? bench.batchLimit() : UINT32_MAX;
+				cursor = 0;
+			};
+			chunk = std::min(batch - done, available);
+			clock::time_point start = clock::now();
+			for (uint32_t i = cursor; i < cursor + chunk; i++) bench.run(i);
+			elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+			available -= chunk;
+			cursor += chunk;
+		};
+		ops += batch;
+		batch *= 2;
+	};
+	return static_cast<double>(elapsed.count()) / ops;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Benchmarks::_writeSyntheticLevel()
+{
+	sf::Image image, density;
+	int hx, hy, r;
+	bool solid;
+
+	// Rock with round holes of growing size and diagonal tunnels, density varies by blocks
+	image.create(BENCH_SYNTHETIC_SIZE_X, BENCH_SYNTHETIC_SIZE_Y, sf::Color::Transparent);
+	density.create(BENCH_SYNTHETIC_SIZE_X, BENCH_SYNTHETIC_SIZE_Y, sf::Color::Transparent);
+	for (int y = 0; y < BENCH_SYNTHETIC_SIZE_Y; y++)
+		for (int x = 0; x < BENCH_SYNTHETIC_SIZE_X; x++)
+		{
+			hx = x % BENCH_SYNTHETIC_HOLE_STEP - BENCH_SYNTHETIC_HOLE_STEP / 2;
+			hy = y % BENCH_SYNTHETIC_HOLE_STEP - BENCH_SYNTHETIC_HOLE_STEP / 2;
+			r = (x / BENCH_SYNTHETIC_HOLE_STEP + y / BENCH_SYNTHETIC_HOLE_STEP) % (BENCH_SYNTHETIC_HOLE_STEP / 2);
+			solid = (hx * hx + hy * hy > r * r) && ((x + y) % 256 >= 16);
+			if (!solid) continue;
+			image.setPixel(x, y, sf::Color(128 + x % 128, 64 + y % 128, 96, 255));
+			density.setPixel(x, y, sf::Color(1, 1, 1, 255));
+		};
+	if (!image.saveToFile(_levelImage) || !density.saveToFile(_levelDensity)) throw "Error writing synthetic level images";
+	// Same level in both slots, so level loading can be compared with the shipped ones
+	std::ofstream levels(_levelsFile.c_str(), std::ofstream::out | std::ofstream::trunc);
+	levels << "[{\"code\": \"BNCH\", \"image\": \"" << _levelImage << "\", \"density\": \"" << _levelDensity << "\", \"gems\": ["
+		"{\"x\": 100, \"y\": 100, \"idx\": 1}, {\"x\": 400, \"y\": 120, \"idx\": 2}, {\"x\": 700, \"y\": 140, \"idx\": 3}]}]\n";
+	if (!levels.good()) throw "Error writing synthetic levels file";
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Benchmarks::_removeSyntheticLevel()
+{
+	remove(_levelImage.c_str());
+	remove(_levelDensity.c_str());
+	remove(_levelsFile.c_str());
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Benchmarks::runAll(bool json)
+{
+	std::vector<BenchCase*> cases;
+	Board board("data/board_bkg.png", true);
+	Board synthetic("data/board_bkg.png", true);
+	Board unpacked("data/board_bkg.png", true);
+	Spritex ball("data/ball.png");
+	Spritex gem("data/gem1.png");
+	Spritex frame("data/board.png", "data/board_density.png");
+	Spritex* syntheticLevel;
+	sf::Vector2f hit, miss;
+	int levelCount;
+	char name[64];
+	const float radii[] = { 16, 32, 64, EXPLOSION_RADIUS };
+	bool first = true;
+
+	_writeSyntheticLevel();
+	synthetic.setLevelsFile(_levelsFile);
+	unpacked.setLevelsFile(LEVELS_FILE);
+	syntheticLevel = new Spritex(_levelImage, _levelDensity);
+	for (levelCount = 0; loadLevel(board, levelCount + 1); levelCount++);
+
+	// Find ball positions over the board frame, where pixels do and don't collide
+	hit = miss = sf::Vector2f(-1, -1);
+	for (float y = 0; y + BALL_SIZE < RESOLUTION_Y; y += BALL_SIZE)
+		for (float x = 0; x + BALL_SIZE < RESOLUTION_X; x += BALL_SIZE)
+		{
+			ball.setPosition(x, y);
+			if (ball.collides(frame, true, false, NULL)) { if (hit.x < 0) hit = sf::Vector2f(x, y); }
+			else if (miss.x < 0) miss = sf::Vector2f(x, y);
+		};
+	if ((hit.x < 0) || (miss.x < 0)) throw "Error: can't find ball positions over the board frame";
+	cases.push_back(new CollideBench("collides/aabb_only/ball_frame", &ball, &frame, hit, sf::Vector2f(0, 0), false));
+	cases.push_back(new CollideBench("collides/pp_hit/ball_frame", &ball, &frame, hit, sf::Vector2f(0, 0), true));
+	cases.push_back(new CollideBench("collides/pp_miss/ball_frame", &ball, &frame, miss, sf::Vector2f(0, 0), true));
+	cases.push_back(new CollideBench("collides/pp_hit/gem_synthetic", &gem, syntheticLevel, sf::Vector2f(0, 0), sf::Vector2f(0, 0), true));
+	cases.push_back(new CollideBench("collides/pp_miss/gem_synthetic", &gem, syntheticLevel,
+		sf::Vector2f((BENCH_SYNTHETIC_HOLE_STEP - 32) / 2 + BENCH_SYNTHETIC_HOLE_STEP * 8, (BENCH_SYNTHETIC_HOLE_STEP - 32) / 2 + BENCH_SYNTHETIC_HOLE_STEP * 8), sf::Vector2f(0, 0), true));
+	cases.push_back(new CollideBench("collides/pp_large/frame_synthetic", &frame, syntheticLevel, sf::Vector2f(0.5f, 0.5f), sf::Vector2f(0, 0), true));
+	cases.push_back(new CollideRemoveBench("collides/remove/ball_level1", &ball, "data/level1.png", "data/level1_density.png"));
+	cases.push_back(new CollideRemoveBench("collides/remove/ball_synthetic", &ball, _levelImage, _levelDensity));
+	for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++)
+	{
+		snprintf(name, sizeof(name), "explosion/r%d/level1", static_cast<int>(radii[r]));
+		cases.push_back(new ExplosionBench(name, board, 1, radii[r]));
+		snprintf(name, sizeof(name), "explosion/r%d/synthetic", static_cast<int>(radii[r]));
+		cases.push_back(new ExplosionBench(name, synthetic, 1, radii[r]));
+	};
+	for (int l = 1; l <= levelCount; l++)
+	{
+		snprintf(name, sizeof(name), "level_load/level%d", l);
+		cases.push_back(new LevelLoadBench(name, board, l));
+		snprintf(name, sizeof(name), "level_load/json/level%d", l);
+		cases.push_back(new LevelLoadBench(name, unpacked, l));
+	};
+	cases.push_back(new LevelLoadBench("level_load/synthetic", synthetic, 1));
+	for (int l = 1; l <= levelCount; l++)
+	{
+		snprintf(name, sizeof(name), "tick/level%d", l);
+		cases.push_back(new TickBench(name, board, l));
+	};
+	cases.push_back(new TickBench("tick/synthetic", synthetic, 1));
+
+	if (json) printf("{\"benchmarks\": [\n");
+	for (std::vector<BenchCase*>::iterator c = cases.begin(); c != cases.end(); ++c)
+	{
+		if (!_filter.empty() && ((*c)->name.find(_filter) == std::string::npos)) continue;
+		uint32_t ops;
+		double ns = _measure(**c, ops);
+		if (json)
+		{
+			printf("%s  {\"name\": \"%s\", \"ns_per_op\": %.1f, \"ops\": %u}", first ? "" : ",\n", (*c)->name.c_str(), ns, ops);
+		}
+		else
+			printf("%-36s %14.1f ns/op %10u ops\n", (*c)->name.c_str(), ns, ops);
+		fflush(stdout);
+		first = false;
+	};
+	if (json) printf("\n]}\n");
+	for (std::vector<BenchCase*>::iterator c = cases.begin(); c != cases.end(); ++c) delete *c;
+	delete syntheticLevel;
+};
+
+}; // namespace Diamondek
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+	bool json = false;
+	uint32_t minTime = BENCH_MIN_TIME_MSEC_DEFAULT;
+	std::string filter;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--json") == 0) { json = true; continue; };
+		if ((strcmp(argv[i], "--filter") == 0) && (i + 1 < argc)) { filter = argv[++i]; continue; };
+		if ((strcmp(argv[i], "--min-time") == 0) && (i + 1 < argc)) { minTime = atoi(argv[++i]); continue; };
+		fprintf(stderr, "Usage: %s [--json] [--filter substring] [--min-time msec]\n", argv[0]);
+		return EXIT_FAILURE;
+	};
+	// Benchmarks measure simulation only, no textures are uploaded
+	Diamondek::Spritex::setHeadless(true);
+	try
+	{
+		Diamondek::Benchmarks benchmarks(minTime, filter);
+		benchmarks.runAll(json);
+	}
+	catch(const char* s)
+	{
+		fprintf(stderr, "%s\n", s);
+		return EXIT_FAILURE;
+	}
+	catch(const std::string& s)
+	{
+		fprintf(stderr, "%s\n", s.c_str());
+		return EXIT_FAILURE;
+	};
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
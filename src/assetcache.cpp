@@ -0,0 +1,198 @@
+/*!
+	\class Diamondek::AssetCache
+    \brief AssetCache class
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "assetcache.h"
+#include "spritex.h"
+#include "levelpack.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<SpritexAsset> SpritexAsset::loadFromFiles(const std::string& pixelmap, const std::string& densitymap, int density)
+{
+	std::shared_ptr<SpritexAsset> asset(new SpritexAsset());
+	sf::Image& pixelImage = asset->_pixels;
+	sf::Image densityImage;
+
+	if (pixelImage.loadFromFile(pixelmap) == false) throw "Error loading image " + pixelmap;
+	asset->_keepPixels = !densitymap.empty();
+	if (densitymap.empty())
+	{
+		// Density could be calculated as a mean of (R,G,B) values, more darken pixels are more though:
+		//density = 255 - (static_cast<float>(c.r + c.g + c.b) / 3);
+		// normalized to maxDensity:
+		//density = (density * maxDensity) / 255;
+		asset->_initMaps(pixelImage, density);
+	}
+	else
+	{
+		if (densityImage.loadFromFile(densitymap) == false) throw "Error loading image " + densitymap;
+		if ((pixelImage.getSize() != densityImage.getSize())) throw "Wrong combination of pixel and density maps";
+		asset->_initMaps(densityImage, 0);
+	};
+	return asset;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<SpritexAsset> SpritexAsset::loadFromPack(const LevelPack& pack, const PackImage* image)
+{
+	std::shared_ptr<SpritexAsset> asset(new SpritexAsset());
+	const SpritexTile* tiles = pack.getTiles(image);
+
+	// Tiles are copied, not referenced: assets are cached and shared by spritexes, which outlive the mapping (pack is closed or changed by
+	// Board::setLevelsFile and setLevelPack), and each image is copied once, when it is cached. Nothing is decoded or summarized
+	asset->size = sf::Vector2u(image->width, image->height);
+	asset->tileColumns = image->tileColumns;
+	asset->tileRows = image->tileRows;
+	asset->tiles.assign(tiles, tiles + image->tileColumns * image->tileRows);
+	// Pixels are copied for the same reason, and pack may be closed before texture is created
+	if (!Spritex::isHeadless()) asset->_pixels.create(image->width, image->height, pack.getRGBA(image));
+	asset->_keepPixels = (image->densitymap[0] != 0);
+	return asset;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<SpritexAsset> SpritexAsset::loadFromMaps(const sf::Vector2u& size, const std::vector<uint8_t>& density, const std::vector<uint64_t>& mask, const sf::Uint8* rgba)
+{
+	std::shared_ptr<SpritexAsset> asset(new SpritexAsset());
+	int stride = (size.x + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+	int sx = size.x;
+	int sy = size.y;
+
+	asset->_initTiles(size);
+	for (int y = 0; y < sy; y++)
+		for (int tx = 0; tx < asset->tileColumns; tx++)
+		{
+			SpritexTile& tile = asset->tiles[(y / SPRITEX_TILE_SIZE) * asset->tileColumns + tx];
+			tile.mask[y % SPRITEX_TILE_SIZE] = mask[y * stride + tx];
+			memcpy(&tile.density[(y % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE], &density[y * sx + tx * SPRITEX_TILE_SIZE],
+				std::min(SPRITEX_TILE_SIZE, sx - tx * SPRITEX_TILE_SIZE));
+		};
+	asset->_summarizeTiles();
+	if (rgba != NULL) asset->_pixels.create(size.x, size.y, rgba);
+	asset->_keepPixels = true;
+	return asset;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void SpritexAsset::createTexture()
+{
+	if (!Spritex::isHeadless())
+	{
+		if ((size.x > sf::Texture::getMaximumSize()) || (size.y > sf::Texture::getMaximumSize()))
+		{ // spritexes draw it from their texture pages, made of kept pixels
+			if (!_keepPixels) throw "Image is too large for texture";
+		}
+		else if (!texture.loadFromImage(_pixels)) throw "Error creating texture";
+	};
+	if (_keepPixels && !Spritex::isHeadless()) return;
+	_pixels = sf::Image();
+	_keepPixels = false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+sf::Vector2i SpritexAsset::getTileSize(int tx, int ty) const
+{
+	return sf::Vector2i(std::min(SPRITEX_TILE_SIZE, static_cast<int>(size.x) - tx * SPRITEX_TILE_SIZE),
+		std::min(SPRITEX_TILE_SIZE, static_cast<int>(size.y) - ty * SPRITEX_TILE_SIZE));
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void SpritexAsset::_initTiles(const sf::Vector2u& imageSize)
+{
+	SpritexTile empty;
+
+	memset(&empty, 0, sizeof(empty));
+	empty.state = TILE_EMPTY;
+	size = imageSize;
+	tileColumns = (size.x + SPRITEX_TILE_SIZE - 1) / SPRITEX_TILE_SIZE;
+	tileRows = (size.y + SPRITEX_TILE_SIZE - 1) / SPRITEX_TILE_SIZE;
+	tiles.assign(tileColumns * tileRows, empty);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void SpritexAsset::_initMaps(const sf::Image& image, int value)
+{
+	int sx = image.getSize().x;
+	int sy = image.getSize().y;
+	const sf::Uint8* pixels = image.getPixelsPtr();
+	int lx;
+
+	_initTiles(image.getSize());
+	for (int y = 0; y < sy; y++)
+		for (int x = 0; x < sx; x++)
+		{
+			SpritexTile& tile = tiles[(y / SPRITEX_TILE_SIZE) * tileColumns + x / SPRITEX_TILE_SIZE];
+			lx = x % SPRITEX_TILE_SIZE;
+			tile.density[(y % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE + lx] = (value != 0) ? value : pixels[(y * sx + x) * 4];
+			if (pixels[(y * sx + x) * 4 + 3] != 0) tile.mask[y % SPRITEX_TILE_SIZE] |= static_cast<uint64_t>(1) << lx;
+		};
+	_summarizeTiles();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void SpritexAsset::_summarizeTiles()
+{
+	sf::Vector2i tileSize;
+
+	for (int ty = 0; ty < tileRows; ty++)
+		for (int tx = 0; tx < tileColumns; tx++)
+		{
+			tileSize = getTileSize(tx, ty);
+			tiles[ty * tileColumns + tx].summarize(tileSize.x, tileSize.y);
+		};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void SpritexTile::summarize(int width, int height)
+{
+	// Bits of pixels out of the image are never solid
+	uint64_t valid = (width == MASK_WORD_BITS) ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << width) - 1;
+	uint64_t any = 0, all = valid;
+
+	for (int y = 0; y < height; y++)
+	{
+		any |= mask[y];
+		all &= mask[y];
+	};
+	state = (any == 0) ? TILE_EMPTY : ((all == valid) ? TILE_FULL : TILE_MIXED);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<SpritexAsset> AssetCache::load(const std::string& pixelmap, const std::string& densitymap, const LevelPack& pack)
+{
+	const PackImage* image = pack.isOpen() ? pack.findImage(pixelmap, densitymap) : NULL;
+
+	if (image != NULL) return SpritexAsset::loadFromPack(pack, image);
+	return SpritexAsset::loadFromFiles(pixelmap, densitymap, MAX_DENSITY_DEFAULT);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+SpritexAssetPtr AssetCache::get(const std::string& pixelmap, const std::string& densitymap, const LevelPack& pack)
+{
+	std::string k = key(pixelmap, densitymap);
+	std::map<std::string, SpritexAssetPtr>::iterator i = _assets.find(k);
+	std::shared_ptr<SpritexAsset> asset;
+
+	if (i != _assets.end()) return i->second;
+	asset = load(pixelmap, densitymap, pack);
+	asset->createTexture();
+	return _assets[k] = asset;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AssetCache::purge()
+{
+	std::map<std::string, SpritexAssetPtr>::iterator i = _assets.begin();
+	while (i != _assets.end())
+	{
+		// Only the cache holds it
+		if (i->second.use_count() == 1) _assets.erase(i++); else ++i;
+	};
+};
+
+}; // namespace Diamondek
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*!
+	\class Diamondek::AssetCache
+    \brief AssetCache class
+
+    Cache of spritex images, keyed by image file names. Pristine pixel data and textures are loaded once and shared by all spritexes made of the same images.
+    Spritexes never change shared data: a damaged spritex gets its own copy of each tile it changes first (see Spritex).
+*/
+
+#ifndef _ASSETCACHE_H_
+#define _ASSETCACHE_H_
+
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Collision mask is packed by 64 pixels per word
+#define MASK_WORD_BITS 64
+// Image is stored by square tiles of this size. A tile row of collision mask is one mask word
+#define SPRITEX_TILE_SIZE MASK_WORD_BITS
+// Tile summary: no solid pixels, all pixels solid, or both
+#define TILE_EMPTY 0
+#define TILE_FULL 1
+#define TILE_MIXED 2
+
+namespace Diamondek {
+
+class LevelPack;
+struct PackImage;
+
+/// Square tile of spritex image: collision mask, density and summary of SPRITEX_TILE_SIZE x SPRITEX_TILE_SIZE pixels.
+/// Pixels of edge tiles, which lie out of the image, are transparent and have no density. Tiles are stored in level pack as they are
+struct SpritexTile
+{
+	/// Collision mask, one word per tile row, bit x is pixel x of the row (1 - solid)
+	uint64_t mask[SPRITEX_TILE_SIZE];
+	/// Density of pixels, row by row
+	uint8_t density[SPRITEX_TILE_SIZE * SPRITEX_TILE_SIZE];
+	/// Summary of collision mask: TILE_EMPTY, TILE_FULL or TILE_MIXED
+	uint8_t state;
+	/// Recompute 'state' of tile, which has 'width' x 'height' pixels inside the image
+	void summarize(int width, int height);
+};
+
+/// Pristine image data of a spritex
+class SpritexAsset
+{
+public:
+	SpritexAsset() : tileColumns(0), tileRows(0), _keepPixels(false) {};
+	/// Size in pixels
+	sf::Vector2u size;
+	/// Tiles of the image, row by row, 'tileColumns' in a row
+	std::vector<SpritexTile> tiles;
+	int tileColumns;
+	int tileRows;
+	/// Texture of pixelmap image, created by 'createTexture' (never in headless mode). It is not created, if the image is larger than a texture may be,
+	/// then spritexes draw it from their own texture pages
+	sf::Texture texture;
+	/// Load asset from 'pixelmap' and 'densitymap' image files, or from 'pixelmap' only with the same 'density' of all pixels, if 'densitymap' is empty.
+	/// Texture is not created, so it can be called from any thread
+	static std::shared_ptr<SpritexAsset> loadFromFiles(const std::string& pixelmap, const std::string& densitymap, int density);
+	/// Load asset from preprocessed 'image' of 'pack'. Nothing is decoded. Texture is not created, so it can be called from any thread
+	static std::shared_ptr<SpritexAsset> loadFromPack(const LevelPack& pack, const PackImage* image);
+	/// Make asset of 'size' from 'density' (row by row), collision 'mask' (one bit per pixel, rows padded to MASK_WORD_BITS) and RGBA pixels 'rgba'
+	/// (may be NULL in headless mode), e.g. cut from another spritex. Texture is not created
+	static std::shared_ptr<SpritexAsset> loadFromMaps(const sf::Vector2u& size, const std::vector<uint8_t>& density, const std::vector<uint64_t>& mask, const sf::Uint8* rgba);
+	/// Upload loaded pixels to 'texture' (unless in headless mode or the image is too large) and free them, unless they are kept.
+	/// Call it from the drawing thread before asset is used
+	void createTexture();
+	/// Return RGBA pixels kept after 'createTexture', or NULL. They are kept for assets with density map and for cut assets, i.e. for destructible ones,
+	/// so that their damaged tiles don't read the texture back
+	const sf::Uint8* getPixels() const { return _keepPixels ? _pixels.getPixelsPtr() : NULL; };
+	/// Return tile 'tx', 'ty'
+	const SpritexTile& getTile(int tx, int ty) const { return tiles[ty * tileColumns + tx]; };
+	/// Return word 'w' of collision mask row 'y', bit x is pixel w * MASK_WORD_BITS + x
+	uint64_t getMaskWord(int w, int y) const { return getTile(w, y / SPRITEX_TILE_SIZE).mask[y % SPRITEX_TILE_SIZE]; };
+	/// Return size of tile 'tx', 'ty' inside the image
+	sf::Vector2i getTileSize(int tx, int ty) const;
+private:
+	/// Allocate empty tiles for image of 'size'
+	void _initTiles(const sf::Vector2u& size);
+	/// Take size, density (R channel, or 'value' for all pixels if it is not 0) and collision mask (alpha channel) from 'image'
+	void _initMaps(const sf::Image& image, int value);
+	/// Summarize all tiles
+	void _summarizeTiles();
+	/// Loaded pixels, kept until 'createTexture', or for good if '_keepPixels' is set
+	sf::Image _pixels;
+	bool _keepPixels;
+};
+
+typedef std::shared_ptr<const SpritexAsset> SpritexAssetPtr;
+
+class AssetCache
+{
+public:
+	/// Return cache key of asset made of 'pixelmap' and 'densitymap'
+	static std::string key(const std::string& pixelmap, const std::string& densitymap) { return pixelmap + '\n' + densitymap; };
+	/// Load asset made of 'pixelmap' and 'densitymap' (empty for spritex made of single image) from 'pack' if it has the images, otherwise from files.
+	/// Texture is not created, so it can be called from any thread
+	static std::shared_ptr<SpritexAsset> load(const std::string& pixelmap, const std::string& densitymap, const LevelPack& pack);
+	/// Return asset made of 'pixelmap' and 'densitymap'. It is loaded only if it is not in the cache yet
+	SpritexAssetPtr get(const std::string& pixelmap, const std::string& densitymap, const LevelPack& pack);
+	/// Return true if asset with 'key' is in the cache
+	bool contains(const std::string& key) const { return _assets.find(key) != _assets.end(); };
+	/// Add 'asset' loaded elsewhere (e.g. by another thread) with 'key'. Its texture must be created already
+	void insert(const std::string& key, const SpritexAssetPtr& asset) { _assets[key] = asset; };
+	/// Drop assets not used by any spritex
+	void purge();
+	/// Drop all assets. Spritexes keep their assets until they are destroyed
+	void clear() { _assets.clear(); };
+	/// Return number of cached assets
+	size_t size() const { return _assets.size(); };
+private:
+	/// Assets by 'key'
+	std::map<std::string, SpritexAssetPtr> _assets;
+};
+
+}; // namespace Diamondek
+
+#endif // _ASSETCACHE_H_
@@ -10,8 +10,8 @@
 
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
+#include <algorithm>
 #include <cmath>
-#include <random>
 #include <stdlib.h>
 #include <fstream>
 #include "rapidjson/document.h"
@@ -19,17 +19,32 @@
 #include "rapidjson/error/en.h"
 #include <string>
 #include "board.h"
+#include "hash.h"
 
 namespace Diamondek {
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-Board::Board(const std::string& backgroundSpriteName)
+Board::Board(const std::string& backgroundSpriteName, bool headless)
 {
-	_nextID = 1;
 	_diamondsGained = 0;
 	_numDiamonds = 0;
 	_numLives = LIVES_MAX;
 	_currentLevel = 1;
+	_levelsFile = LEVELS_FILE;
+	_headless = headless;
+	_lastInput = inNone;
+	_cheatInput = inNone;
+	_isBallJustGlued = false;
+	_tickCount = 0;
+	_recording = NULL;
+	_preloadEnabled = !headless;
+	_preloadLevelNum = 0;
+	// Windowed games differ from each other, headless runs are reproducible
+	setSeed(headless ? RNG_SEED_DEFAULT : std::random_device()());
+	Spritex::setHeadless(headless);
+	// Pack is optional, without it levels and images are loaded from their source files
+	_pack.open(LEVEL_PACK_FILE, _levelsFile);
+	if (headless) return;
 	_background.loadFromFile(backgroundSpriteName);
 
 	// Load font and init some strings
@@ -43,183 +58,185 @@ Board::Board(const std::string& backgroundSpriteName)
 	if (!_harvestSoundBuffer.loadFromFile("data/sounds/game_harvest.wav")) throw "Error loading music 'game_harvest.wav'";
 	_harvestSound.setBuffer(_harvestSoundBuffer);
 	// Prepare some Texts
-	_sNumGems.setFont(_font);
-	_sNumGems.setPosition(GEMS_TEXT_X, GEMS_TEXT_Y);
-	_sNumGems.setScale(0.5, 0.5);
-	_sNumLives.setFont(_font);
-	_sNumLives.setPosition(LIVES_TEXT_X, LIVES_TEXT_Y);
-	_sNumLives.setScale(0.5, 0.5);
-	_sLevelInfo.setFont(_font);
-	_sLevelInfo.setPosition(LEVEL_INFO_TEXT_X, LEVEL_INFO_TEXT_Y);
-	_sLevelInfo.setScale(0.5, 0.5);
+	_hud.setFont(_font);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 Board::~Board()
 {
+	_cancelPreload();
 	_clearSpritexes();
 };
 
 void Board::_clearSpritexes()
 {
-	Spritex* s;
-	SpritexMapIterator i = _spritexes.begin();
+	_entities.clear();
+	_broadphase.clear();
+};
 
-	while(!_spritexes.empty())
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_removeDeadSpritexes()
+{
+	for (int i = 0; i < _entities.size(); i++)
 	{
-		s = (*i).second;
-		_spritexes.erase(i++);
-		delete(s);
+		if (_entities.isDead(i)) _broadphase.remove(_entities.getID(i));
 	};
+	_entities.removeDead();
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-uint32_t Board::addSpritex(Spritex* s)
+uint32_t Board::addSpritex(const SpritexAssetPtr& asset, uint32_t flags)
 {
-	/// \todo Implement check for duplicates
-	_spritexes[_nextID] = s;
-	++_nextID;
-	return _nextID-1;
+	uint32_t id = _entities.add(asset, flags);
+	_updateBroadphase(id);
+	return id;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Board::removeSpritex(Spritex* s)
+void Board::_queryCandidates(const sf::FloatRect& aabb)
 {
-	Spritex* cur;
-	SpritexMapIterator i = _spritexes.begin();
-	while(!_spritexes.empty())
-	{
-		cur = (*i).second;
-		if (cur == s)
-		{
-			cur->setDead();
-			return;
-		};
-		++i;
-	};
+	_broadphase.query(aabb, _candidates);
+	std::sort(_candidates.begin(), _candidates.end(), [this](uint32_t a, uint32_t b) { return _entities.indexOf(a) < _entities.indexOf(b); });
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-Spritex* Board::getSpritex(uint32_t id)
+void Board::removeSpritex(uint32_t id)
 {
-	return _spritexes[id];
+	int i = _entities.indexOf(id);
+	if (i >= 0) _entities.setDead(i);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Board::removeCollidingBackground(Spritex* s)
+void Board::removeCollidingBackground(uint32_t id)
 {
-	for (SpritexMapIterator iter = _spritexes.begin(); iter != _spritexes.end(); ++iter)
-    {
-		if (((*iter).second) == s) continue;
-		s->collides(*((*iter).second), true, true, NULL);
+	Spritex* s = getSpritex(id);
+	_queryCandidates(s->getGlobalAABB());
+	for (std::vector<uint32_t>::iterator i = _candidates.begin(); i != _candidates.end(); ++i)
+	{
+		if (*i == id) continue;
+		s->collides(*getSpritex(*i), true, true, NULL);
+	};
+	// Pixels are removed from the larger spritex of each pair, that may be any of them
+	_wakeUnsupportedGems(id);
+	for (std::vector<uint32_t>::iterator i = _candidates.begin(); i != _candidates.end(); ++i)
+	{
+		if (*i != id) _wakeUnsupportedGems(*i);
 	};
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Board::drawBoard(sf::RenderTarget& target)
+void Board::drawBoard(sf::RenderTarget& target, float alpha)
 {
 	sf::Sprite s;
+	sf::RenderStates states;
+	Spritex* p;
 	s.setTexture(_background);
 	target.draw(s);
-	for (SpritexMapIterator i = _spritexes.begin(); i != _spritexes.end(); ++i) {
-		((*i).second)->draw(target, sf::RenderStates::Default);
+	// Atlas space of debris, which is gone, is reused
+	_batch.releaseDynamicAssets();
+	// Spritexes are drawn in entity order: runs of batched ones are drawn at once, and the batch is flushed before a damaged one (the level),
+	// which is drawn on its own
+	for (int i = 0; i < _entities.size(); i++) {
+		p = _entities.getPixels(i);
+		p->flushDamage();
+		// Spritex is positioned at the current tick, shift it back to the interpolated position
+		states.transform = sf::Transform::Identity;
+		states.transform.translate(_entities.getRenderPosition(i, alpha) - _entities.getPosition(i));
+		if (_batch.accepts(*p)) _batch.add(*p, states.transform);
+		else
+		{
+			_batch.draw(target);
+			p->draw(target, states);
+		};
 	};
+	_batch.draw(target);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Board::setPaddleSpeed(sf::Vector2f speed)
 {
-	getSpritex(_paddleID)->setSpeed(speed);
+	_entities.setSpeed(_entities.indexOf(_paddleID), speed);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Board::setBallSpeed(sf::Vector2f speed)
 {
-	getSpritex(_ballID)->setSpeed(speed);
+	_entities.setSpeed(_entities.indexOf(_ballID), speed);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Board::processSpritexes()
 {
-	sf::Vector2f vel, rvect, curPos;
+	sf::Vector2f vel;
+	float dot;
 	CollisionData collisionData;
+	uint32_t id;
+	sf::Vector2f startPos, startSpeed;
+	sf::FloatRect startAABB, changed;
 
-	for (SpritexMapIterator i = _spritexes.begin(); i != _spritexes.end();)
+	_predictCollisions();
+	for (int i = 0; i < _entities.size(); i++)
 	{
-		if (((*i).second->isDynamic()))
+		id = _entities.getID(i);
+		if (_entities.isDynamic(i) && !_entities.isDead(i) && !_entities.isSleeping(i))
 		{
+			startPos = _entities.getPosition(i);
+			startSpeed = _entities.getSpeed(i);
+			startAABB = _entities.getAABB(i);
 			// Try to move spritex
-			curPos = ((*i).second)->getPosition();
-			(*i).second->physicsTick();
-			// Check for collision
-			if (_findCollision((*i).second, &collisionData))
+			_entities.physicsTick(i);
+			_updateBroadphase(id);
+			// Check for collision and move spritex to position right before it. Bodies found clear in parallel don't collide
+			if (!_isPredictedClear(i) && _sweepCollision(id, _entities.getSpeed(i), &collisionData))
 			{
-				// Move spritex to position right before collision
-				rvect = (*i).second->getSpeed();
-				if (rvect.x + rvect.y != 0) // push away along reverse speed vector
-				{
-					rvect /= sqrt((rvect.x * rvect.x) + (rvect.y * rvect.y)); // normalize rvect
-					rvect *= 0.45f; // we've got a little vector looking opposite direction of the spritex speed vector
-					do // push spritex away from another one
-					{
-						(*i).second->setPosition((*i).second->getPosition() - rvect);
-					} while (_findCollision((*i).second, NULL));
-				};
 				// If the ball hit object, apply explosion to the object and change ball's direction
-				if ((*i).second == getSpritex(_ballID))
+				if (id == _ballID)
 				{
-					_ballHitSound.play();
+					_playSound(_ballHitSound);
 					_applyExplosion(&collisionData);
-					// Calculate reflected velocity vector
-					curPos = ((*i).second)->getPosition();
-					vel = ((*i).second)->getSpeed();
-					curPos += sf::Vector2f((float)((*i).second)->getSize().x / 2, (float)((*i).second)->getSize().y / 2); // curPos = center of sprite
-					// rvect is a normal to the tangent line to the ball passing through collision point (CO vector, where C is a collision point, O is a center of spritex)
-					rvect = collisionData.collisionPoint - curPos;
-					rvect /= sqrt((rvect.x * rvect.x) + (rvect.y * rvect.y)); // normalize rvect
-					// Simply revert one coordinate depending on rvect direction
-					#define COS45 0.70710678118654752440084436210485f
-					#define COS135 -0.70710678118654752440084436210485f
-					// 
-					// 1 
-					if (rvect.x > COS45 && rvect.y > COS135 && rvect.y < COS45)
-					{
-						vel.x = -vel.x;
-					};
-					// 2
-					if (rvect.x < COS135 && rvect.y > COS135 && rvect.y < COS45)
-					{
-						vel.x = -vel.x;
-					};
-					// 3
-					if(rvect.x > COS135 && rvect.x < COS45 && rvect.y < COS135)
-					{
-						vel.y = -vel.y;
-					};
-					// 4
-					if (rvect.x > COS135 && rvect.x < COS45 && rvect.y > COS45)
-					{
-						vel.y = -vel.y;
-					};
-					(*i).second->setSpeed(vel);
+					// Reflect velocity from the contact surface, as it was before explosion. Ball, which already moves away, is left alone, so it can't get trapped
+					vel = _entities.getSpeed(i);
+					dot = vel.x * collisionData.normal.x + vel.y * collisionData.normal.y;
+					if (dot < 0) vel -= collisionData.normal * (2 * dot);
+					_entities.setSpeed(i, vel);
 				};
-				// Special events for diamon collision
-				if ((*i).second->isDiamond())
+				// Special events for diamon and debris collision
+				if (_entities.isDiamond(i) || _entities.isDebris(i))
 				{
-					(*i).second->setSpeed(sf::Vector2f(0, 0)); // Stop diamond falling
-					if (collisionData.collisionee == getSpritex(_paddleID)) _harvestDiamond((*i).second); // Apply diamond harvesting, if diamond hit paddle
+					_entities.setSpeed(i, sf::Vector2f(0, 0)); // Stop falling
+					if (collisionData.collisioneeID == _paddleID)
+					{ // Apply diamond harvesting, if diamond hit paddle. Debris is crushed by it
+						if (_entities.isDiamond(i)) _harvestDiamond(id); else _crushDebris(id);
+					}
+					// Body, which stood still for the whole tick, will do the same on every next tick, until something changes around it
+					else if ((_entities.getPosition(i) == startPos) && (startSpeed == sf::Vector2f(0, 0))) _entities.setSleeping(i, true);
 				};
 				// Special events for paddle collision
-				if ((*i).second == getSpritex(_paddleID))
+				if (id == _paddleID)
 				{
-					if (collisionData.collisionee->isDiamond()) _harvestDiamond(collisionData.collisionee);
+					if (_entities.isDiamond(_entities.indexOf(collisionData.collisioneeID))) _harvestDiamond(collisionData.collisioneeID);
+					if (_entities.isDebris(_entities.indexOf(collisionData.collisioneeID))) _crushDebris(collisionData.collisioneeID);
 				};
 			};
+			if (_entities.getPosition(i) != startPos)
+			{
+				const sf::FloatRect& aabb = _entities.getAABB(i);
+				changed.left = std::min(startAABB.left, aabb.left);
+				changed.top = std::min(startAABB.top, aabb.top);
+				changed.width = std::max(startAABB.left + startAABB.width, aabb.left + aabb.width) - changed.left;
+				changed.height = std::max(startAABB.top + startAABB.height, aabb.top + aabb.height) - changed.top;
+				// Gems resting on this spritex may fall, when it moves away, and gems in its way are hit
+				_wakeGems(changed);
+				// Predictions of the next bodies, which this one may have met, are not valid anymore
+				if (!_predicted.empty()) _changes.update(id, changed);
+			};
 		};
+		// Debris, which fell out of screen, is not needed anymore
+		if (_entities.isDebris(i) && _isOutOfScreen(i)) _crushDebris(id);
 		// If diamond was not picked up by the player and it was gone, then harvest it anyway
-		if (((*i).second)->isDiamond())
+		if (_entities.isDiamond(i))
 		{
-			if (_diamondIsOutOfScreen((*(*i).second))) _harvestDiamond((*i).second);
+			if (_diamondIsOutOfScreen(i)) _harvestDiamond(id);
 			// Player won
 			if (_diamondsGained == _numDiamonds)
 			{
@@ -231,17 +248,8 @@ void Board::processSpritexes()
 				return;
 			};
 		};
-		// Remove dead spritexes
-		if (((*i).second)->isDead())
-		{
-			delete (*i).second;
-		    _spritexes.erase(i++);
-		}
-		else
-		{
-			i++;
-		};
-	}; // for (SpritexMapIterator i = _spritexes.begin(); i != _spritexes.end();)
+	}; // for (int i = 0; i < _entities.size(); i++)
+	_removeDeadSpritexes();
 	if (_ballIsOutOfScreen())
 	{
 		_numLives--;
@@ -252,25 +260,31 @@ void Board::processSpritexes()
 		else
 		{
 			_isBallGluedToPaddle = true;
+			_isBallJustGlued = true;
 		};
 	};
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-bool Board::_findCollision(Spritex* s, CollisionData* collisionData)
+bool Board::_findCollision(uint32_t id, CollisionData* collisionData)
 {
-	Spritex* d;
-	for (SpritexMapIterator i = _spritexes.begin(); i != _spritexes.end(); i++)
+	int d;
+	Spritex* s = getSpritex(id);
+	// Only spritexes with intersecting AABBs may collide
+	_queryCandidates(_entities.getAABB(_entities.indexOf(id)));
+	for (std::vector<uint32_t>::iterator i = _candidates.begin(); i != _candidates.end(); i++)
     {
-		d = (*i).second;
-		if (s == d) continue; // skip self
+		if (*i == id) continue; // skip self
+		d = _entities.indexOf(*i);
+		if (_entities.isDead(d)) continue; // already harvested
 		sf::Vector2f tmpV;
-		if (s->collides(*d, true, false, &tmpV))
+		if (s->collides(*_entities.getPixels(d), true, false, &tmpV))
 		{
 			if (collisionData != 0)
 			{
 				collisionData->collisionPoint = tmpV;
-				collisionData->collisionee = d;
+				collisionData->collisionee = _entities.getPixels(d);
+				collisionData->collisioneeID = *i;
 			};
 			return true;
 		};
@@ -278,84 +292,317 @@ bool Board::_findCollision(Spritex* s, CollisionData* collisionData)
 	return false;
 };
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_sweepCollision(uint32_t id, const sf::Vector2f& motion, CollisionData* collisionData)
+{
+	if (!_findCollision(id, collisionData)) return false;
+	float len = sqrt(motion.x * motion.x + motion.y * motion.y);
+	if (len == 0)
+	{ // there is no direction to move back along
+		collisionData->timeOfImpact = 0;
+		collisionData->normal = _contactNormal(id, sf::Vector2f(0, -1));
+		return true;
+	};
+	sf::Vector2f dir = motion / len;
+	// [clearPos, hitPos] brackets the contact along the motion, hitPos collides
+	sf::Vector2f hitPos = _entities.getPosition(_entities.indexOf(id));
+	sf::Vector2f clearPos = hitPos - motion;
+	float gap = len;
+	float step = std::max(len, SWEEP_MIN_STEP);
+	int steps = 0;
+	// Something may have moved into the spritex, so the start of motion collides too. March further back with growing steps
+	while (_collidesAt(id, clearPos, collisionData))
+	{
+		hitPos = clearPos;
+		if (++steps > SWEEP_MAX_STEPS)
+		{ // hopelessly stuck, leave it as is
+			collisionData->timeOfImpact = 0;
+			collisionData->normal = _contactNormal(id, -dir);
+			return true;
+		};
+		clearPos -= dir * step;
+		gap = step;
+		step *= 2;
+	};
+	// Bisect the bracket down to SWEEP_PRECISION
+	sf::Vector2f mid;
+	while (gap > SWEEP_PRECISION)
+	{
+		mid = (clearPos + hitPos) / 2.0f;
+		gap /= 2;
+		if (_collidesAt(id, mid, collisionData)) hitPos = mid; else clearPos = mid;
+	};
+	// Contact normal is taken at the first colliding position
+	_moveSpritex(id, hitPos);
+	collisionData->normal = _contactNormal(id, -dir);
+	_moveSpritex(id, clearPos);
+	// Fraction of the motion passed before contact. Negative, if spritex was moved back behind the start of motion
+	sf::Vector2f passed = clearPos - (hitPos - motion);
+	collisionData->timeOfImpact = (passed.x * dir.x + passed.y * dir.y) / len;
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_collidesAt(uint32_t id, const sf::Vector2f& position, CollisionData* collisionData)
+{
+	_moveSpritex(id, position);
+	return _findCollision(id, collisionData);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+sf::Vector2f Board::_contactNormal(uint32_t id, const sf::Vector2f& fallback)
+{
+	Spritex* s = getSpritex(id);
+	sf::Vector2f sum(0, 0);
+	int count = 0;
+	int d;
+	_queryCandidates(_entities.getAABB(_entities.indexOf(id)));
+	for (std::vector<uint32_t>::iterator i = _candidates.begin(); i != _candidates.end(); ++i)
+	{
+		if (*i == id) continue;
+		d = _entities.indexOf(*i);
+		if (_entities.isDead(d)) continue;
+		count += s->overlap(*_entities.getPixels(d), &sum);
+	};
+	if (count == 0) return fallback;
+	sf::Vector2f n = s->getTransform().transformPoint(s->getSize() / 2.0f) - sum / static_cast<float>(count);
+	float len = sqrt(n.x * n.x + n.y * n.y);
+	if (len == 0) return fallback;
+	return n / len;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_moveSpritex(uint32_t id, const sf::Vector2f& position)
+{
+	_entities.setPosition(_entities.indexOf(id), position);
+	_updateBroadphase(id);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_placeSpritex(uint32_t id, const sf::Vector2f& position)
+{
+	_entities.teleport(_entities.indexOf(id), position);
+	_updateBroadphase(id);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+sf::Vector2f Board::_gluedBallPosition()
+{
+	sf::Vector2f paddlePos = _entities.getPosition(_entities.indexOf(_paddleID));
+	return sf::Vector2f(paddlePos.x + (PADDLE_WIDTH - BALL_SIZE)/2, paddlePos.y - BALL_SIZE);
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 bool Board::_ballIsOutOfScreen()
 {
-	Spritex* ball = getSpritex(_ballID);
-	sf::FloatRect ballRect = ball->getTransform().transformRect(ball->getAABB());
+	sf::FloatRect ballRect = _entities.getAABB(_entities.indexOf(_ballID));
 	sf::FloatRect screenRect(0, 0, RESOLUTION_X, RESOLUTION_Y);
 	return !screenRect.intersects(ballRect);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-bool Board::_diamondIsOutOfScreen(const Spritex& s)
+bool Board::_diamondIsOutOfScreen(int i)
+{
+	return _entities.isDiamond(i) && _isOutOfScreen(i);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_isOutOfScreen(int i)
 {
-	if (!s.isDiamond()) return false;
-	sf::FloatRect diamondRect = s.getTransform().transformRect(s.getAABB());
 	sf::FloatRect screenRect(0, 0, RESOLUTION_X, RESOLUTION_Y);
-	return !screenRect.intersects(diamondRect);
+	return !screenRect.intersects(_entities.getAABB(i));
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Board::_applyExplosion(CollisionData* collisionData)
+int Board::_applyExplosion(CollisionData* collisionData, float radius)
 {
-	if (!collisionData->collisionee->isDestructible()) return;
+	if (!_entities.isDestructible(_entities.indexOf(collisionData->collisioneeID))) return 0;
 
-	sf::Vector2f cur, cp;
-	double distortion, distance;
-	uint8_t density;
+	sf::Vector2f cp;
 
-	_explodeSound.play();
-	srand((unsigned)time(NULL));
+	_playSound(_explodeSound);
 	cp = collisionData->collisionPoint; // collisionPoint contains global coordinates of last collision point
 	cp = collisionData->collisionee->getInverseTransform().transformPoint(cp); // transform 'cp' to local 'collisionee' coordinates
-	// Find explosion boundaries
-	int miny = cp.y - EXPLOSION_RADIUS > 0 ? static_cast<int>(cp.y - EXPLOSION_RADIUS) : 0;
-	int maxy = cp.y + EXPLOSION_RADIUS < collisionData->collisionee->getSize().y ? static_cast<int>(cp.y + EXPLOSION_RADIUS) : static_cast<int>(collisionData->collisionee->getSize().y);
-	int minx = cp.x - EXPLOSION_RADIUS > 0 ? static_cast<int>(cp.x - EXPLOSION_RADIUS) : 0;
-	int maxx = cp.x + EXPLOSION_RADIUS < collisionData->collisionee->getSize().x ? static_cast<int>(cp.x + EXPLOSION_RADIUS) : static_cast<int>(collisionData->collisionee->getSize().x);
-	// Apply explosion per pixel
-	for (int y = miny; y < maxy; y++)
-		for (int x = minx; x < maxx; x++)
+	// Pixels closer than radius/2 lose one density level, pixels which lost all density are destroyed
+	int destroyed = collisionData->collisionee->explode(cp, radius / 2);
+	_detachDebris(collisionData->collisioneeID);
+	_wakeUnsupportedGems(collisionData->collisioneeID);
+	return destroyed;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_harvestDiamond(uint32_t id)
+{
+	if (_entities.isDead(_entities.indexOf(id))) return; // already harvested during this tick
+	_playSound(_harvestSound);
+	_diamondsGained++;
+	removeSpritex(id);
+	// Gems may stand on it
+	_wakeGems(_entities.getAABB(_entities.indexOf(id)));
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_detachDebris(uint32_t id)
+{
+	int i = _entities.indexOf(id);
+	Spritex* s = _entities.getPixels(i);
+	sf::IntRect damage;
+	std::shared_ptr<SpritexAsset> asset;
+	uint32_t debrisID;
+
+	// Falling bodies just carry their loose pixels with them
+	if (!_entities.isDestructible(i) || _entities.isDynamic(i) || !s->getMaskDamage(damage)) return;
+	_debrisFinder.find(*s, damage, _islands);
+	for (std::vector<DebrisFinder::Island>::iterator island = _islands.begin(); island != _islands.end(); ++island)
+	{
+		_debrisFinder.getIslandMask(*island, _islandMask);
+		// Crumbles away, its pixels are just cleared without building an asset
+		if (island->pixels < DEBRIS_MIN_PIXELS)
 		{
-			distance = sqrt((x - cp.x) * (x - cp.x) + ((y - cp.y) * (y - cp.y)));
-			//distortion = ((double)rand() / (RAND_MAX + 1) * EXPLOSION_MAX_DISTORTION);
-			distortion = 0;
-			if (distance <= EXPLOSION_RADIUS/2 + distortion)
-			{
-				density = collisionData->collisionee->getDensityAt(x, y);
-				if (density == 0) continue; // pixel is already empty
-				--density;
-				if (density == 0) // destroy pixel
-				{
-					collisionData->collisionee->setPixel(x, y, sf::Color::Transparent);
-					collisionData->collisionee->setDensityAt(x, y, 0, 0);
-				}
-				else // update pixel density
-				{
-				// TODO: ball sticks in the collisionee when this enabled. Need fix
-				//	collisionData->collisionee->setDensityAt(x, y, density, 255);
-				};
-			};
+			s->erase(island->bounds, _islandMask);
+			continue;
 		};
+		asset = s->cut(island->bounds, _islandMask);
+		asset->createTexture();
+		// Debris is drawn by the batch, until it is damaged
+		if (!_headless) _batch.addDynamicAsset(asset);
+		debrisID = addSpritex(asset, efDynamic | efDestructible | efDebris);
+		_placeSpritex(debrisID, s->getTransform().transformPoint(static_cast<float>(island->bounds.left), static_cast<float>(island->bounds.top)));
+		_entities.applyForce(_entities.indexOf(debrisID), sf::Vector2f(0, G_ACCELERATION));
+	};
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Board::_harvestDiamond(Spritex* diamond)
+void Board::_predictCollisions()
 {
-	_harvestSound.play();
-	_diamondsGained++;
-	removeSpritex(diamond);
+	_predicted.clear();
+	_changes.clear();
+	for (int i = 0; i < _entities.size(); i++)
+	{
+		if (!(_entities.isDiamond(i) || _entities.isDebris(i)) || _entities.isDead(i) || _entities.isSleeping(i) || !_entities.isDynamic(i)) continue;
+		if (!_entities.getPixels(i)->isTranslationOnly()) continue;
+		_predicted.push_back(i);
+	};
+	// Few bodies are cheaper to test one by one, and without other threads tests would be just repeated
+	if ((_predicted.size() < PARALLEL_MIN_BODIES) || (_pool.getThreads() < 2))
+	{
+		_predicted.clear();
+		return;
+	};
+	_predictedClear.assign(_entities.size(), 0);
+	// Nothing is changed until all jobs are done, so they only read the board
+	_pool.run(static_cast<int>(_predicted.size()), [this](int k)
+	{
+		// Scratch list of each worker thread
+		static thread_local std::vector<uint32_t> candidates;
+		int i = _predicted[k];
+		int d;
+		Spritex* s = _entities.getPixels(i);
+		// The same position and AABB, as physicsTick will make
+		sf::Vector2f position = _entities.getPosition(i) + (_entities.getSpeed(i) + _entities.getAcceleration(i));
+		sf::Transformable moved(*s);
+		moved.setPosition(position);
+		_broadphase.query(moved.getTransform().transformRect(s->getAABB()), candidates);
+		for (std::vector<uint32_t>::iterator c = candidates.begin(); c != candidates.end(); ++c)
+		{
+			if (*c == _entities.getID(i)) continue;
+			d = _entities.indexOf(*c);
+			if (_entities.isDead(d)) continue;
+			// Collision, or unknown: the body is tested again in its turn
+			if (!_entities.getPixels(d)->isTranslationOnly() || s->collidesAt(position, *_entities.getPixels(d))) return;
+		};
+		_predictedClear[i] = 1;
+	});
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_isPredictedClear(int i)
+{
+	if ((i >= static_cast<int>(_predictedClear.size())) || (_predictedClear[i] == 0) || _predicted.empty()) return false;
+	_changes.query(_entities.getAABB(i), _wakeCandidates);
+	return _wakeCandidates.empty();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_crushDebris(uint32_t id)
+{
+	if (_entities.isDead(_entities.indexOf(id))) return;
+	removeSpritex(id);
+	// Gems may stand on it
+	_wakeGems(_entities.getAABB(_entities.indexOf(id)));
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+sf::FloatRect Board::_gemSupportRegion(int i) const
+{
+	sf::FloatRect r = _entities.getAABB(i);
+	r.left -= GEM_SUPPORT_MARGIN;
+	r.width += 2 * GEM_SUPPORT_MARGIN;
+	r.height += GEM_SUPPORT_MARGIN;
+	return r;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_wakeGems(const sf::FloatRect& changed)
+{
+	int d;
+	// Support regions stick out of AABBs, which broadphase knows
+	sf::FloatRect r(changed.left - GEM_SUPPORT_MARGIN, changed.top - GEM_SUPPORT_MARGIN, changed.width + 2 * GEM_SUPPORT_MARGIN, changed.height + 2 * GEM_SUPPORT_MARGIN);
+	_broadphase.query(r, _wakeCandidates);
+	for (std::vector<uint32_t>::iterator i = _wakeCandidates.begin(); i != _wakeCandidates.end(); ++i)
+	{
+		d = _entities.indexOf(*i);
+		if (_entities.isSleeping(d) && changed.intersects(_gemSupportRegion(d))) _entities.setSleeping(d, false);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_wakeUnsupportedGems(uint32_t id)
+{
+	Spritex* s = getSpritex(id);
+	sf::IntRect damage;
+	sf::FloatRect changed;
+	int d;
+
+	if (!s->takeMaskDamage(damage)) return;
+	changed = s->getTransform().transformRect(sf::FloatRect(damage));
+	changed = sf::FloatRect(changed.left - GEM_SUPPORT_MARGIN, changed.top - GEM_SUPPORT_MARGIN, changed.width + 2 * GEM_SUPPORT_MARGIN, changed.height + 2 * GEM_SUPPORT_MARGIN);
+	_broadphase.query(changed, _wakeCandidates);
+	for (std::vector<uint32_t>::iterator i = _wakeCandidates.begin(); i != _wakeCandidates.end(); ++i)
+	{
+		d = _entities.indexOf(*i);
+		if (!_entities.isSleeping(d) || !changed.intersects(_gemSupportRegion(d))) continue;
+		if (*i == id)
+		{ // damaged body itself (debris) may have lost pixels it stood on
+			_entities.setSleeping(d, false);
+			continue;
+		};
+		// Gem, which still stands on the damaged spritex, would stop at the same place again. Otherwise it may fall (or stand on something else, then it sleeps again soon)
+		if (!_isSupportedBy(d, *s)) _entities.setSleeping(d, false);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_isSupportedBy(int i, Spritex& support)
+{
+	Spritex* s = _entities.getPixels(i);
+	sf::Vector2f p = s->getPosition();
+	bool supported;
+
+	// Sleeping gem collides as soon as it enters the next pixel row, and its support is what it meets there. Only whole pixel steps are exact
+	if (!s->isTranslationOnly() || !support.isTranslationOnly() || (support.getPosition() != sf::Vector2f(floor(support.getPosition().x), floor(support.getPosition().y)))) return false;
+	s->setPosition(p.x, floor(p.y) + 1);
+	supported = s->collides(support, true, false, NULL);
+	s->setPosition(p);
+	return supported;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-sf::Vector2f Board::_deviateVectorToRandomAngle(sf::Vector2f& v, float maxAngle)
+sf::Vector2f Board::_deviateVectorToRandomAngle(const sf::Vector2f& v, float maxAngle)
 {
-	std::mt19937 rng;
-    rng.seed(std::random_device()());
-    std::uniform_int_distribution<std::mt19937::result_type> dist(0, 1000);
-	double rotationDirection = (dist(rng) % 2) == 0 ? -1.0 : +1.0;
-	double k = dist(rng) / 1000.0;
+	// std::mt19937 output is the same everywhere, unlike std::uniform_int_distribution, so recordings replay on any platform
+	double rotationDirection = (_rng() % 2) == 0 ? -1.0 : +1.0;
+	double k = (_rng() % 1001) / 1000.0;
 	double cosa = cos(maxAngle * k * rotationDirection);
 	double sina = sin(maxAngle * k * rotationDirection);
 	float vlen = sqrt(v.x * v.x + v.y * v.y);
@@ -370,19 +617,22 @@ sf::Vector2f Board::_deviateVectorToRandomAngle(sf::Vector2f& v, float maxAngle)
 void Board::run(sf::RenderWindow &gameWindow)
 {
 	sf::Event Event;
-	sf::Clock updateClock;
-	int lastUpdateTimeMSec = 0;
+	const sf::Time tickTime = sf::microseconds(UPDATE_PERIOD_USEC);
+	FrameScheduler scheduler(gameWindow, "game");
+	int ticks;
 
 	isRunning = true;
 	isPaused = false;
 	loadLevelData(_currentLevel);
-	updateClock.restart();
+	_startTicks();
+	_accumulator = sf::Time::Zero;
 	resetClock();
 	_music.setVolume(20); _music.setLoop(true); _music.play();
+	scheduler.setAnimating(true);
 	while (isRunning)
     {
-		// Handle events
-        while (gameWindow.pollEvent(Event))
+		// Handle events, sleep until the next frame if there are none. Paused game sleeps until the next event
+        while (isRunning && scheduler.waitEvent(Event))
         {
 			switch(Event.type)
 			{
@@ -402,17 +652,17 @@ void Board::run(sf::RenderWindow &gameWindow)
 						case sf::Keyboard::P:
 							isPaused = ! isPaused;
 							resetClock();
+							scheduler.setAnimating(!isPaused);
+							scheduler.invalidate();
 							break;
 						//
 						// Some debug cheats
 						//
 						case sf::Keyboard::Add:
-							_diamondsGained = _numDiamonds;
+							_cheatInput |= inNextLevel;
 							break;
 						case sf::Keyboard::Subtract:
-							// Further it'll be incremented and we got to _currentLevel-1 level actually
-							_currentLevel -= 2;
-							_diamondsGained = _numDiamonds;
+							_cheatInput |= inPrevLevel;
 							break;
 					};
 					break;
@@ -420,67 +670,243 @@ void Board::run(sf::RenderWindow &gameWindow)
 					break;
 			};
 		};
-		// Handle input
-		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left) && !sf::Keyboard::isKeyPressed(sf::Keyboard::Right))
+		// Run as many fixed ticks as real time has passed
+		_accumulator += _clock.restart();
+		if (isPaused) _accumulator = sf::Time::Zero;
+		ticks = 0;
+		while ((_accumulator >= tickTime) && isRunning)
 		{
-			setPaddleSpeed(sf::Vector2f(-PADDLE_SPEED, 0));
-		} else
+			if (ticks == MAX_CATCHUP_TICKS)
+			{ // can't keep up, drop the rest
+				_accumulator = sf::Time::Zero;
+				break;
+			};
+			tick(_readKeyboard() | _cheatInput);
+			_cheatInput = inNone;
+			_accumulator -= tickTime;
+			ticks++;
+		};
+		// Game may be paused by input too, paused game is drawn once more to show it
+		if (scheduler.isAnimating() == isPaused)
 		{
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right) && !sf::Keyboard::isKeyPressed(sf::Keyboard::Left))
-			{
-				setPaddleSpeed(sf::Vector2f(+PADDLE_SPEED, 0));
-			}
-			else
-				setPaddleSpeed(sf::Vector2f(0, 0));
+			scheduler.setAnimating(!isPaused);
+			scheduler.invalidate();
 		};
-		if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) && _isBallGluedToPaddle)
+		// Texts are rebuilt only when shown values change
+		if (_hud.update(_diamondsGained, _numDiamonds, _numLives, _levelInfo, isPaused)) scheduler.invalidate();
+		if (!scheduler.frameDue()) continue;
+		gameWindow.clear();
+		drawBoard(gameWindow, _accumulator / tickTime);
+		gameWindow.draw(_hud);
+		gameWindow.display();
+		scheduler.frameDone();
+    };
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::tick(uint32_t input)
+{
+	if (_recording && (input != _recording->getInput(_tickCount))) _recording->setInput(_tickCount, input);
+	// Pause toggles when key is pressed, not while it is held
+	if ((input & inPause) && !(_lastInput & inPause)) isPaused = !isPaused;
+	_lastInput = input;
+	if (!isPaused)
+	{
+		_entities.savePositions();
+		_applyCheats(input);
+		_applyInput(input);
+		if (_isBallGluedToPaddle)
 		{
-			_isBallGluedToPaddle = false;
-			//sf::Vector2f bs = _deviateVectorToRandomAngle(sf::Vector2f(BALL_SPEED_X, BALL_SPEED_Y), 30.0f * 3.14159265f / 180.0f);
-			sf::Vector2f bs = _deviateVectorToRandomAngle(sf::Vector2f(BALL_SPEED_X, BALL_SPEED_Y), 1);
-			setBallSpeed(bs);
+			// Lost ball appears on the paddle instead of flying to it from the bottom of the screen
+			if (_isBallJustGlued) _placeSpritex(_ballID, _gluedBallPosition()); else _moveSpritex(_ballID, _gluedBallPosition());
+			_isBallJustGlued = false;
 		};
+		processSpritexes();
+	};
+	if (_recording) _recording->setHash(_tickCount, getStateHash());
+	_tickCount++;
+};
 
-		gameWindow.clear();
-		if (!isPaused && (updateClock.getElapsedTime().asMilliseconds() - lastUpdateTimeMSec) > UPDATE_PERIOD_MSEC)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_startTicks()
+{
+	_tickCount = 0;
+	_lastInput = inNone;
+	if (!_recording) return;
+	_recording->clear();
+	_recording->setLevel(_currentLevel);
+	_recording->setSeed(_seed);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t Board::runHeadless(uint32_t levelNum, uint32_t ticks, const InputScript& script)
+{
+	uint32_t t;
+
+	isRunning = true;
+	isPaused = false;
+	_currentLevel = levelNum;
+	if (!loadLevelData(_currentLevel)) return 0;
+	_startTicks();
+	for (t = 0; (t < ticks) && isRunning; t++) tick(script.getInput(t));
+	return t;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::replay(const InputScript& recording, uint32_t& failedTick)
+{
+	uint64_t hash;
+
+	isRunning = true;
+	isPaused = false;
+	_currentLevel = recording.getLevel();
+	setSeed(recording.getSeed());
+	failedTick = 0;
+	if (!loadLevelData(_currentLevel)) return false;
+	_startTicks();
+	for (uint32_t t = 0; t < recording.getLength(); t++)
+	{
+		if (!isRunning) // game was over earlier than in recording
 		{
-			if (_isBallGluedToPaddle)
-			{
-				sf::Vector2f paddlePos = getSpritex(_paddleID)->getPosition();
-				getSpritex(_ballID)->setPosition(paddlePos.x + (PADDLE_WIDTH - BALL_SIZE)/2, paddlePos.y - BALL_SIZE);
-			}
-			processSpritexes();
-			lastUpdateTimeMSec = updateClock.getElapsedTime().asMilliseconds();
+			failedTick = t;
+			return false;
 		};
-		drawBoard(gameWindow);
-		_sNumGems.setString(boost::lexical_cast<std::string>((int)(_diamondsGained)) + "/" + boost::lexical_cast<std::string>((int)(_numDiamonds)));
-		_sNumLives.setString(boost::lexical_cast<std::string>((int)(_numLives)));
-		_sLevelInfo.setString(_levelInfo);
-		gameWindow.draw(_sNumGems);
-		gameWindow.draw(_sNumLives);
-		gameWindow.draw(_sLevelInfo);
-		if (isPaused)
+		tick(recording.getInput(t));
+		if (recording.getHash(t, hash) && (hash != getStateHash()))
 		{
-			sf::Text pausedText("Paused", _font, PAUSED_FONT_SIZE);
-			sf::FloatRect fr = pausedText.getGlobalBounds();
-			pausedText.setPosition((RESOLUTION_X - fr.width) / 2, RESOLUTION_Y - PAUSED_FONT_SIZE * 1.5);
-			gameWindow.draw(pausedText);
+			failedTick = t;
+			return false;
 		};
-		gameWindow.display();
-		// Calculate FPS
-    };
+	};
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t Board::_readKeyboard()
+{
+	uint32_t input = inNone;
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) input |= inLeft;
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) input |= inRight;
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) input |= inLaunch;
+	return input;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_applyInput(uint32_t input)
+{
+	if ((input & inLeft) && !(input & inRight))
+	{
+		setPaddleSpeed(sf::Vector2f(-PADDLE_SPEED, 0));
+	} else
+	{
+		if ((input & inRight) && !(input & inLeft))
+		{
+			setPaddleSpeed(sf::Vector2f(+PADDLE_SPEED, 0));
+		}
+		else
+			setPaddleSpeed(sf::Vector2f(0, 0));
+	};
+	if ((input & inLaunch) && _isBallGluedToPaddle)
+	{
+		_isBallGluedToPaddle = false;
+		//sf::Vector2f bs = _deviateVectorToRandomAngle(sf::Vector2f(BALL_SPEED_X, BALL_SPEED_Y), 30.0f * 3.14159265f / 180.0f);
+		sf::Vector2f bs = _deviateVectorToRandomAngle(sf::Vector2f(BALL_SPEED_X, BALL_SPEED_Y), 1);
+		setBallSpeed(bs);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_applyCheats(uint32_t input)
+{
+	// Level is changed by processSpritexes, when all diamonds are gained
+	if (input & inNextLevel) _diamondsGained = _numDiamonds;
+	if (input & inPrevLevel)
+	{
+		// Further it'll be incremented and we got to _currentLevel-1 level actually
+		_currentLevel -= 2;
+		_diamondsGained = _numDiamonds;
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Board::getStateHash()
+{
+	uint64_t h = HASH_INIT;
+	h = hashValue(h, _currentLevel);
+	h = hashValue(h, _diamondsGained);
+	h = hashValue(h, _numLives);
+	h = hashValue(h, _isBallGluedToPaddle);
+	for (int i = 0; i < _entities.size(); i++)
+	{
+		h = hashValue(h, _entities.getID(i));
+		// Sleeping is an optimisation, which must not change the course of the game, so it is not hashed
+		h = hashValue(h, _entities.getFlags(i) & ~efSleeping);
+		h = hashValue(h, _entities.getPosition(i).x);
+		h = hashValue(h, _entities.getPosition(i).y);
+		h = hashValue(h, _entities.getSpeed(i).x);
+		h = hashValue(h, _entities.getSpeed(i).y);
+		h = hashValue(h, _entities.getPixels(i)->getMaskHash());
+	};
+	return h;
 };
 
 bool Board::loadLevelData(int levelNum)
+{
+	LevelDescription level;
+	bool ready = false;
+
+	if (_preload.valid() && (_preloadLevelNum == levelNum))
+	{ // Level was read and its images decoded in background, only textures are left to create
+		try
+		{
+			PreloadedLevel preloaded = _preload.get();
+			for (std::vector<PreloadedAsset>::iterator a = preloaded.assets.begin(); a != preloaded.assets.end(); ++a)
+			{
+				if (_assets.contains(a->key)) continue;
+				a->asset->createTexture();
+				_assets.insert(a->key, a->asset);
+			};
+			level = preloaded.level;
+			ready = preloaded.valid;
+		}
+		catch(...)
+		{ // Level is loaded again below, errors are handled there
+		};
+	};
+	_cancelPreload();
+	if (!ready) ready = _readLevel(levelNum, level);
+	// Clear old level data and reload base resources
+	_clearSpritexes();
+	loadResources();
+	if (!ready || !_buildLevel(level)) return false;
+	// Decode the next level while this one is played
+	_startPreload(levelNum + 1);
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_readLevel(int levelNum, LevelDescription& level) const
 {
 	using namespace rapidjson;
 	Document d;
 	//libconfig::Config levels;
-	std::string levelCode, levelImage, levelDensity;
-	unsigned int tmpID, gemCount, gx, gy, gemIdx;
+	unsigned int gemCount;
+	PackGem gem;
 
+	level.gems.clear();
+	if (_pack.isOpen())
+	{
+		const PackLevel* packLevel = _pack.getLevel(levelNum);
+		if (packLevel == NULL) return false;
+		const PackImage* image = _pack.getImage(packLevel->imageIndex);
+		level.code = packLevel->code;
+		level.image = image->pixelmap;
+		level.density = image->densitymap;
+		for (uint32_t gc = 0; gc < packLevel->gemCount; gc++) level.gems.push_back(*_pack.getGem(packLevel, gc));
+		return true;
+	};
 	// Open data file
-	std::ifstream levelsFile("data/levels.json", std::ifstream::in);
+	std::ifstream levelsFile(_levelsFile.c_str(), std::ifstream::in);
 	std::string s((std::istreambuf_iterator<char>(levelsFile)), std::istreambuf_iterator<char>());
 	levelsFile.close();
 	ParseResult pr = d.Parse(s.c_str());
@@ -489,9 +915,6 @@ bool Board::loadLevelData(int levelNum)
 	}
 	if (!d.IsArray()) return false;
 	//levels.readFile("data/levels.dat");
-	// Clear old level data and reload base resources
-	_clearSpritexes();
-	loadResources();
 	// Read level
 	////const libconfig::Setting& root = levels.getRoot(); 
 	try
@@ -500,38 +923,27 @@ bool Board::loadLevelData(int levelNum)
 		////int levelCount = levels.getLength();
 		int levelCount = d.Capacity();
 		if (levelNum <= 0 || levelNum > levelCount) return false;
-		levelCode = d[levelNum-1]["code"].GetString();
-		levelImage = d[levelNum-1]["image"].GetString();
-		levelDensity = d[levelNum-1]["density"].GetString();
+		level.code = d[levelNum-1]["code"].GetString();
+		level.image = d[levelNum-1]["image"].GetString();
+		level.density = d[levelNum-1]["density"].GetString();
 		////const libconfig::Setting& level = levels[levelNum - 1];
 		////level.lookupValue("code", levelCode);
 		////level.lookupValue("image", levelImage);
 		////level.lookupValue("density", levelDensity);
-		tmpID = addSpritex(new Diamondek::Spritex(levelImage, levelDensity));
-		getSpritex(tmpID)->isDynamic(false);
-		getSpritex(tmpID)->isDestructible(true);
-		getSpritex(tmpID)->isDiamond(false);
 		gemCount = d[levelNum - 1]["gems"].Capacity();
 		////const libconfig::Setting& gems = level["gems"];
 		////gemCount = gems.getLength();
 		for (unsigned int gc = 0; gc < gemCount; gc++)
 		{
-			gx = d[levelNum - 1]["gems"][gc]["x"].GetInt();
-			gy = d[levelNum - 1]["gems"][gc]["y"].GetInt();
-			gemIdx = d[levelNum - 1]["gems"][gc]["idx"].GetInt();
+			gem = PackGem();
+			gem.x = d[levelNum - 1]["gems"][gc]["x"].GetInt();
+			gem.y = d[levelNum - 1]["gems"][gc]["y"].GetInt();
+			gem.idx = d[levelNum - 1]["gems"][gc]["idx"].GetInt();
 			////gems[gc].lookupValue("x", gx);
 			////gems[gc].lookupValue("y", gy);
 			////gems[gc].lookupValue("idx", gemIdx);
-			tmpID = addSpritex(new Diamondek::Spritex(std::string("data/gem").append(boost::lexical_cast<std::string>(gemIdx)).append(".png")));
-			getSpritex(tmpID)->isDynamic(true);
-			getSpritex(tmpID)->isDestructible(false);
-			getSpritex(tmpID)->isDiamond(true);
-			getSpritex(tmpID)->setPosition(static_cast<float>(gx), static_cast<float>(gy));
-			getSpritex(tmpID)->applyForce(sf::Vector2f(0, G_ACCELERATION));
-			removeCollidingBackground(getSpritex(tmpID));
+			level.gems.push_back(gem);
 		};
-		setNumberOfDiamonds(gemCount);
-		_levelInfo = "Level " + boost::lexical_cast<std::string>((int)(_currentLevel)) + ", code: " + levelCode;
 	}
 	catch(...)
 	{
@@ -540,30 +952,114 @@ bool Board::loadLevelData(int levelNum)
 	return true;
 };
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Board::_buildLevel(const LevelDescription& level)
+{
+	try
+	{
+		addSpritex(_getAsset(level.image, level.density), efDestructible);
+		for (std::vector<PackGem>::const_iterator g = level.gems.begin(); g != level.gems.end(); ++g) _addGem(g->idx, g->x, g->y);
+	}
+	catch(...)
+	{
+		return false;
+	};
+	if (!_headless)
+	{ // Atlas of images, which are never damaged
+		std::vector<SpritexAssetPtr> atlasAssets;
+		for (int i = 0; i < _entities.size(); i++)
+			if (!_entities.isDestructible(i)) atlasAssets.push_back(_entities.getPixels(i)->getAsset());
+		_batch.setAssets(atlasAssets);
+	};
+	// Assets of the previous level are not used anymore
+	_assets.purge();
+	setNumberOfDiamonds(static_cast<uint32_t>(level.gems.size()));
+	_levelInfo = "Level " + boost::lexical_cast<std::string>((int)(_currentLevel)) + ", code: " + level.code;
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Board::PreloadedLevel Board::_decodeLevel(int levelNum) const
+{
+	PreloadedLevel preloaded;
+	PreloadedAsset a;
+	std::vector<std::pair<std::string, std::string> > images;
+
+	preloaded.valid = _readLevel(levelNum, preloaded.level);
+	if (!preloaded.valid) return preloaded;
+	images.push_back(std::make_pair(preloaded.level.image, preloaded.level.density));
+	for (std::vector<PackGem>::const_iterator g = preloaded.level.gems.begin(); g != preloaded.level.gems.end(); ++g)
+		images.push_back(std::make_pair(_gemImage(g->idx), std::string()));
+	for (std::vector<std::pair<std::string, std::string> >::iterator i = images.begin(); i != images.end(); ++i)
+	{
+		a.key = AssetCache::key(i->first, i->second);
+		if (std::find(images.begin(), i, *i) != i) continue; // already decoded
+		a.asset = AssetCache::load(i->first, i->second, _pack);
+		preloaded.assets.push_back(a);
+	};
+	return preloaded;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_startPreload(int levelNum)
+{
+	_cancelPreload();
+	if (!_preloadEnabled) return;
+	_preloadLevelNum = levelNum;
+	try
+	{
+		_preload = std::async(std::launch::async, &Board::_decodeLevel, this, levelNum);
+	}
+	catch(...)
+	{ // No threads, next level will be loaded synchronously
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_cancelPreload()
+{
+	// Worker reads '_pack' and '_levelsFile', so it must finish before they change
+	if (_preload.valid()) _preload.wait();
+	_preload = std::future<PreloadedLevel>();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Board::_addGem(unsigned int gemIdx, int x, int y)
+{
+	uint32_t tmpID = addSpritex(_getAsset(_gemImage(gemIdx)), efDynamic | efDiamond);
+	_placeSpritex(tmpID, sf::Vector2f(static_cast<float>(x), static_cast<float>(y)));
+	_entities.applyForce(_entities.indexOf(tmpID), sf::Vector2f(0, G_ACCELERATION));
+	removeCollidingBackground(tmpID);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::string Board::_gemImage(unsigned int gemIdx)
+{
+	return GEM_IMAGE_PREFIX + boost::lexical_cast<std::string>(gemIdx) + GEM_IMAGE_SUFFIX;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+SpritexAssetPtr Board::_getAsset(const std::string& pixelmap, const std::string& densitymap)
+{
+	return _assets.get(pixelmap, densitymap, _pack);
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Board::loadResources()
 {
 	uint32_t tmpID;
 
 	// Load board
-	tmpID = addSpritex(new Diamondek::Spritex("data/board.png", "data/board_density.png"));
-	getSpritex(tmpID)->isDynamic(false);
-	getSpritex(tmpID)->isDestructible(false);
-	getSpritex(tmpID)->isDiamond(false);
+	addSpritex(_getAsset(BOARD_IMAGE, BOARD_DENSITY_IMAGE), efNone);
 	// Load ball
-	tmpID = addSpritex(new Diamondek::Spritex("data/ball.png"));
-	getSpritex(tmpID)->isDynamic(true);
-	getSpritex(tmpID)->isDestructible(false);
-	getSpritex(tmpID)->isDiamond(false);
-	getSpritex(tmpID)->setPosition(PADDLE_POS_X + PADDLE_WIDTH/2, PADDLE_POS_Y - PADDLE_HEIGHT);
+	tmpID = addSpritex(_getAsset(BALL_IMAGE), efDynamic);
+	_placeSpritex(tmpID, sf::Vector2f(PADDLE_POS_X + PADDLE_WIDTH/2, PADDLE_POS_Y - PADDLE_HEIGHT));
 	setBallID(tmpID);
 	_isBallGluedToPaddle = true;
+	_isBallJustGlued = false;
 	// Load paddle
-	tmpID = addSpritex(new Diamondek::Spritex("data/paddle.png"));
-	getSpritex(tmpID)->isDynamic(true);
-	getSpritex(tmpID)->isDestructible(false);
-	getSpritex(tmpID)->isDiamond(false);
-	getSpritex(tmpID)->setPosition(PADDLE_POS_X, PADDLE_POS_Y);
+	tmpID = addSpritex(_getAsset(PADDLE_IMAGE), efDynamic);
+	_placeSpritex(tmpID, sf::Vector2f(PADDLE_POS_X, PADDLE_POS_Y));
 	setPaddleID(tmpID);
 };
 
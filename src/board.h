@@ -9,8 +9,19 @@
 #define _BOARD_H_
 
 #include <SFML/Audio.hpp>
+#include <random>
+#include <future>
 #include "globals.h"
 #include "spritex.h"
+#include "entitystore.h"
+#include "broadphase.h"
+#include "input.h"
+#include "levelpack.h"
+#include "framescheduler.h"
+#include "renderbatch.h"
+#include "hud.h"
+#include "debris.h"
+#include "threadpool.h"
 
 namespace Diamondek {
 
@@ -18,46 +29,108 @@ class CollisionData {
 public:
 	sf::Vector2f collisionPoint;
 	Diamondek::Spritex* collisionee;
+	uint32_t collisioneeID;
+	/// Fraction of the last motion passed before contact (filled by Board::_sweepCollision)
+	float timeOfImpact;
+	/// Unit normal of the contact, pointing away from the obstacles (filled by Board::_sweepCollision before any damage is done)
+	sf::Vector2f normal;
 };
 
 class Board
 {
+	/// Benchmarks drive private hot paths directly
+	friend class Benchmarks;
 public:
-    explicit Board(const std::string& backgroundSpriteName);
+	/// In headless mode board doesn't use textures, fonts and sounds, so it can be run without a window
+    explicit Board(const std::string& backgroundSpriteName, bool headless = false);
 	~Board();
 	void loadResources();
 	void setBallID(uint32_t ballID) { _ballID = ballID; };
 	void setPaddleID(uint32_t paddleID) { _paddleID = paddleID; };
 	void setNumberOfDiamonds(uint32_t n) { _numDiamonds = n; };
-	/// Add spritex object to board and return its ID
-	uint32_t addSpritex(Spritex* s);
-	/// Remove spritex object from board
-	void removeSpritex(Spritex* s);
+	/// Add spritex object made of 'asset' with entity flags 'flags' to board and return its ID
+	uint32_t addSpritex(const SpritexAssetPtr& asset, uint32_t flags);
+	/// Mark spritex object as dead, it will be removed from board at the end of the tick
+	void removeSpritex(uint32_t id);
 	/// Return pointer to spritex object with specified id or null;
-	Spritex* getSpritex(uint32_t id);
-	/// Remove all colliding pixels of ALL spritexes (even undestructable), that collide with s. Really big power is there
-	void removeCollidingBackground(Spritex* s);
-	/// Draw spritexes
-	void drawBoard(sf::RenderTarget& target);
+	Spritex* getSpritex(uint32_t id) { return _entities.getSpritex(id); };
+	/// Remove all colliding pixels of ALL spritexes (even undestructable), that collide with spritex 'id'. Really big power is there
+	void removeCollidingBackground(uint32_t id);
+	/// Draw spritexes at positions interpolated between the previous and the current tick by 'alpha' (0..1)
+	void drawBoard(sf::RenderTarget& target, float alpha = 1);
 	/// Manual speed control of the paddle
 	void setPaddleSpeed(sf::Vector2f speed);
 	/// Manual speed control of the ball
 	void setBallSpeed(sf::Vector2f speed);
 	/// Process movement, physics and collision detection of spritexes
 	void processSpritexes();
-	/// Reset internal game timer
+	/// Reset internal game timer, time passed since the last frame is not simulated
 	void resetClock() { _clock.restart(); };
 	/// Main game loop
 	void run(sf::RenderWindow &gameWindow);
+	/// Advance simulation by one fixed time step with player input 'input' (combination of inputFlags)
+	void tick(uint32_t input);
+	/// Run game from level 'levelNum' for 'ticks' ticks (or until game is over) as fast as possible, with input from 'script'.
+	/// Return number of ticks run
+	uint32_t runHeadless(uint32_t levelNum, uint32_t ticks, const InputScript& script);
+	/// Replay recorded game 'recording' from its level with its seed, and check state hash after every tick.
+	/// Return true if all hashes match, otherwise return false and first diverged tick in 'failedTick'
+	bool replay(const InputScript& recording, uint32_t& failedTick);
+	/// Record input and state hash of every tick to 'recording', or stop recording if it is NULL. Board doesn't take ownership of 'recording'
+	void setRecording(InputScript* recording) { _recording = recording; };
+	/// Reseed random generator. Game with the same seed, level and input runs the same way
+	void setSeed(uint32_t seed) { _seed = seed; _rng.seed(seed); };
+	uint32_t getSeed() const { return _seed; };
+	/// Return hash of simulation state: entity positions, speeds, flags, destruction masks and game counters
+	uint64_t getStateHash();
+	/// Read levels from 'filename' instead of LEVELS_FILE. Level pack is not used after this call
+	void setLevelsFile(const std::string& filename) { _cancelPreload(); _levelsFile = filename; _pack.close(); _assets.clear(); };
+	/// Read levels and images from level pack 'filename' instead of LEVEL_PACK_FILE. Return false if it is not a valid pack, or it was made of another levels file
+	bool setLevelPack(const std::string& filename) { _cancelPreload(); _assets.clear(); return _pack.open(filename, _levelsFile); };
+	/// Enable or disable decoding of the next level in background while current one is played. It is enabled by default, except in headless mode
+	void setPreload(bool enabled) { _preloadEnabled = enabled; if (!enabled) _cancelPreload(); };
 	/// game states
 	bool isPaused, isRunning;
 private:
+	/// Level as described in levels file or level pack
+	class LevelDescription {
+	public:
+		std::string code;
+		/// Level pixelmap and densitymap
+		std::string image, density;
+		std::vector<PackGem> gems;
+	};
+	/// Asset decoded in background, its texture is not created yet
+	class PreloadedAsset {
+	public:
+		std::string key;
+		std::shared_ptr<SpritexAsset> asset;
+	};
+	/// Level read and decoded in background
+	class PreloadedLevel {
+	public:
+		/// False if there is no such level
+		bool valid;
+		LevelDescription level;
+		/// Assets of level image and gems
+		std::vector<PreloadedAsset> assets;
+	};
 	/// Ball and paddle ID's
 	uint32_t _paddleID, _ballID;
 	/// Current level
 	uint32_t _currentLevel;
 	/// Current level information
 	std::string _levelInfo;
+	/// Levels description file
+	std::string _levelsFile;
+	/// Memory-mapped level pack, if it is open levels and images are taken from it instead of '_levelsFile' and image files
+	LevelPack _pack;
+	/// Images shared by spritexes, base resources and repeated gems are loaded once
+	AssetCache _assets;
+	/// Level being decoded in background, number '_preloadLevelNum'. Declared after '_pack', so it is destroyed (and waited for) before it
+	std::future<PreloadedLevel> _preload;
+	int _preloadLevelNum;
+	bool _preloadEnabled;
 	/// Current number of diamonds gained by the player. If _diamondsGained == _numDiamonds then level is completed
 	uint32_t _diamondsGained;
 	/// Total number of diamonds on the level
@@ -66,31 +139,136 @@ private:
 	uint32_t _numLives;
 	/// True,   ""       
 	bool _isBallGluedToPaddle;
+	/// True if ball was lost and glued to the paddle again, so that it is put on the paddle without interpolation
+	bool _isBallJustGlued;
 	///    
 	void _stickBallToPaddle();
 	/// Return true, if ball is outside of visible screen area, else false
 	bool _ballIsOutOfScreen();
-	/// Return true, if given gem is outside of visible screen area, else false
-	bool _diamondIsOutOfScreen(const Spritex& s);
-	/// Collision detection of spritex 's'
-	/// If 's' collide with other spritex, return true and collision point global coordinates with pointer to colliding object in collisionData,
+	/// Return true, if gem with index 'i' is outside of visible screen area, else false
+	bool _diamondIsOutOfScreen(int i);
+	/// Return true, if entity with index 'i' is outside of visible screen area, else false
+	bool _isOutOfScreen(int i);
+	/// Collision detection of spritex 'id'
+	/// If it collides with other spritex, return true and collision point global coordinates with pointer to colliding object in collisionData,
 	/// otherwise return false and collisionPoint remains unchanged.
-	bool _findCollision(Spritex* s, CollisionData* collisionData);
-	/// Explode radius of wall, with epicentre in collisionData.collisionPoint
-	void _applyExplosion(CollisionData* collisionData);
+	bool _findCollision(uint32_t id, CollisionData* collisionData);
+	/// Swept collision detection of spritex 'id', which has just moved by 'motion'.
+	/// If it collides, move it back along 'motion' to position right before contact, fill collisionData with contact point and time of impact, and return true.
+	/// Number of collision tests is bounded by SWEEP_MAX_STEPS and SWEEP_PRECISION
+	bool _sweepCollision(uint32_t id, const sf::Vector2f& motion, CollisionData* collisionData);
+	/// Return unit normal of the contact of spritex 'id' at its current position: direction from the centroid of overlapping pixels of all obstacles
+	/// to the spritex centre. Return 'fallback' if nothing overlaps
+	sf::Vector2f _contactNormal(uint32_t id, const sf::Vector2f& fallback);
+	/// Move spritex 'id' to 'position' and run collision detection
+	bool _collidesAt(uint32_t id, const sf::Vector2f& position, CollisionData* collisionData);
+	/// Explode radius of wall, with epicentre in collisionData.collisionPoint. Return number of destroyed pixels
+	int _applyExplosion(CollisionData* collisionData, float radius = EXPLOSION_RADIUS);
 	/// Remove diamond from scene and increase paddle energy
-	void _harvestDiamond(Spritex* diamond);
+	void _harvestDiamond(uint32_t id);
+	/// Cut islands of pixels, which lost their connection because of the last damage, off static destructible spritex 'id' and add them as falling debris
+	void _detachDebris(uint32_t id);
+	/// Remove debris 'id' from scene
+	void _crushDebris(uint32_t id);
+	/// Test awake falling bodies (gems and debris) for collisions at their next positions in parallel, before anything is changed in the tick.
+	/// Results are used only by bodies, which nothing moved around before their turn, so the tick runs exactly as if they were tested one by one
+	void _predictCollisions();
+	/// Return true if falling body with index 'i', which has just moved, was predicted not to collide, and nothing has changed around it since
+	bool _isPredictedClear(int i);
+	/// Return region around gem with index 'i', where changes may make it move: its AABB grown by GEM_SUPPORT_MARGIN to the sides and down
+	sf::FloatRect _gemSupportRegion(int i) const;
+	/// Wake up sleeping gems, whose support region intersects 'changed' (global coordinates)
+	void _wakeGems(const sf::FloatRect& changed);
+	/// Take collision mask damage of spritex 'id' and wake up sleeping gems near it, which are not supported by it anymore
+	void _wakeUnsupportedGems(uint32_t id);
+	/// Return true if gem with index 'i' collides with 'support', when it is one pixel lower
+	bool _isSupportedBy(int i, Spritex& support);
 	/// Deviate vector direction to random angle. Max deviation angle is 'maxAngle'[radians]
-	sf::Vector2f _deviateVectorToRandomAngle(sf::Vector2f& v, float maxAngle);
-	/// Clear _spritexes
-	void Board::_clearSpritexes();
-	/// Load levels number 'levelNum' data
+	sf::Vector2f _deviateVectorToRandomAngle(const sf::Vector2f& v, float maxAngle);
+	/// Clear _entities
+	void _clearSpritexes();
+	/// Load levels number 'levelNum' data. It is taken from background preload, if it was started for this level
 	bool loadLevelData(int levelNum);
+	/// Read description of level number 'levelNum' from '_pack' or '_levelsFile'. Safe to call from another thread
+	bool _readLevel(int levelNum, LevelDescription& level) const;
+	/// Add spritexes of 'level'
+	bool _buildLevel(const LevelDescription& level);
+	/// Read level 'levelNum' and load its images without creating textures. Runs in background
+	PreloadedLevel _decodeLevel(int levelNum) const;
+	/// Start decoding level 'levelNum' in background (if preload is enabled)
+	void _startPreload(int levelNum);
+	/// Wait for background decoding to finish and drop its result
+	void _cancelPreload();
+	/// Add gem number 'gemIdx' at ('x', 'y')
+	void _addGem(unsigned int gemIdx, int x, int y);
+	/// Return image file of gem number 'gemIdx'
+	static std::string _gemImage(unsigned int gemIdx);
+	/// Return asset of 'pixelmap' and 'densitymap' images (or of 'pixelmap' only, if 'densitymap' is empty), shared through '_assets'.
+	/// Images are taken from '_pack' if they are there
+	SpritexAssetPtr _getAsset(const std::string& pixelmap, const std::string& densitymap = "");
+	/// Start ticks counting and recording (if any) from level '_currentLevel'
+	void _startTicks();
+
+	/// Move spritex 'id' to 'position' and update broadphase grid
+	void _moveSpritex(uint32_t id, const sf::Vector2f& position);
+	/// The same as '_moveSpritex', but spritex appears at 'position' without sliding in from the previous one
+	void _placeSpritex(uint32_t id, const sf::Vector2f& position);
+	/// Return position of the ball glued to the paddle
+	sf::Vector2f _gluedBallPosition();
+	/// Move spritex 'id' to its current position in the broadphase grid
+	void _updateBroadphase(uint32_t id) { _broadphase.update(id, _entities.getAABB(_entities.indexOf(id))); };
+	/// Fill '_candidates' with IDs of spritexes, whose AABBs intersect 'aabb', in the order of '_entities' (the order they were added).
+	/// Broadphase sorts IDs, but slots of removed entities are reused, so ID order is not the order of entities
+	void _queryCandidates(const sf::FloatRect& aabb);
+	/// Remove dead spritexes from board
+	void _removeDeadSpritexes();
+	/// Return player input from keyboard
+	uint32_t _readKeyboard();
+	/// Apply player input to paddle and ball
+	void _applyInput(uint32_t input);
+	/// Apply debug cheats of player input
+	void _applyCheats(uint32_t input);
+	/// Play sound, unless board is headless
+	void _playSound(sf::Sound& sound) { if (!_headless) sound.play(); };
+
+	/// True if board runs without window
+	bool _headless;
+	/// Input of the previous tick
+	uint32_t _lastInput;
+	/// Debug cheats pressed since the last tick. They are passed to the next tick as input, so recordings have them
+	uint32_t _cheatInput;
+	/// Number of ticks since level was started by run(), runHeadless() or replay()
+	uint32_t _tickCount;
+	/// Recording of current game, or NULL
+	InputScript* _recording;
+	/// Random generator. All randomness of the game must come from it, or replays diverge
+	std::mt19937 _rng;
+	/// Seed of _rng
+	uint32_t _seed;
 
 	/// Spritexes on the board
-	SpritexMap _spritexes;
-	uint32_t _nextID;
+	EntityStore _entities;
+	/// Broadphase grid of spritexes AABBs
+	Broadphase _broadphase;
+	/// Scratch list of broadphase query results
+	std::vector<uint32_t> _candidates;
+	/// Scratch list of broadphase query results, used to find gems to wake up
+	std::vector<uint32_t> _wakeCandidates;
+	/// Workers of parallel tick phases
+	ThreadPool _pool;
+	/// Indices of bodies tested by '_predictCollisions' and, by entity index, 1 if it found body clear
+	std::vector<int> _predicted;
+	std::vector<uint8_t> _predictedClear;
+	/// Regions changed by moved bodies during the tick (union of AABBs before and after), after '_predictCollisions' was run
+	Broadphase _changes;
+	/// Search of debris and its scratch buffers
+	DebrisFinder _debrisFinder;
+	std::vector<DebrisFinder::Island> _islands;
+	std::vector<uint64_t> _islandMask;
+	/// Frame timer
 	sf::Clock _clock;
+	/// Simulation time not consumed by ticks yet
+	sf::Time _accumulator;
 	
 	/// Sound stuff
 	sf::Music _music;
@@ -104,9 +282,10 @@ private:
 	/// internal stuff
 	sf::Font _font;
 	sf::Texture _background;
-	sf::Text _sNumLives;
-	sf::Text _sNumGems;
-	sf::Text _sLevelInfo;
+	/// Gems, lives, level info and pause texts
+	Hud _hud;
+	/// Spritexes with undamaged textures are drawn with one draw call
+	RenderBatch _batch;
 
 };
 
@@ -0,0 +1,120 @@
+/*! 
+	\class Diamondek::Broadphase
+    \brief Broadphase class
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "broadphase.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Broadphase::Broadphase()
+{
+	_cellsX = (RESOLUTION_X + BROADPHASE_CELL_SIZE - 1) / BROADPHASE_CELL_SIZE;
+	_cellsY = (RESOLUTION_Y + BROADPHASE_CELL_SIZE - 1) / BROADPHASE_CELL_SIZE;
+	_cells.resize(_cellsX * _cellsY);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Broadphase::~Broadphase()
+{
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Broadphase::update(uint32_t id, const sf::FloatRect& aabb)
+{
+	sf::IntRect cells = _cellRange(aabb);
+	uint32_t slot = id & ENTITY_SLOT_MASK;
+	if (slot >= _entries.size())
+	{
+		Entry none;
+		none.id = ENTITY_NONE;
+		_entries.resize(slot + 1, none);
+	};
+	Entry& e = _entries[slot];
+	e.aabb = aabb;
+	if (e.id != id)
+	{
+		if (e.id != ENTITY_NONE) _removeFromCells(e.id, e.cells); // previous object of the slot was not removed
+		e.id = id;
+		e.cells = cells;
+		_addToCells(id, cells);
+		return;
+	};
+	if (e.cells == cells) return; // object is still in the same cells
+	_removeFromCells(id, e.cells);
+	_addToCells(id, cells);
+	e.cells = cells;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Broadphase::remove(uint32_t id)
+{
+	uint32_t slot = id & ENTITY_SLOT_MASK;
+	if ((slot >= _entries.size()) || (_entries[slot].id != id)) return;
+	_removeFromCells(id, _entries[slot].cells);
+	_entries[slot].id = ENTITY_NONE;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Broadphase::clear()
+{
+	for (std::vector<std::vector<uint32_t> >::iterator i = _cells.begin(); i != _cells.end(); ++i) i->clear();
+	_entries.clear();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Broadphase::query(const sf::FloatRect& aabb, std::vector<uint32_t>& result) const
+{
+	sf::IntRect cells = _cellRange(aabb);
+	result.clear();
+	for (int cy = cells.top; cy < cells.top + cells.height; cy++)
+		for (int cx = cells.left; cx < cells.left + cells.width; cx++)
+		{
+			const std::vector<uint32_t>& cell = _cells[cy * _cellsX + cx];
+			for (std::vector<uint32_t>::const_iterator i = cell.begin(); i != cell.end(); ++i)
+			{
+				if (_entries[*i & ENTITY_SLOT_MASK].aabb.intersects(aabb)) result.push_back(*i);
+			};
+		};
+	// Object may be found in several cells
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+sf::IntRect Broadphase::_cellRange(const sf::FloatRect& aabb) const
+{
+	int minX = static_cast<int>(floor(aabb.left / BROADPHASE_CELL_SIZE));
+	int minY = static_cast<int>(floor(aabb.top / BROADPHASE_CELL_SIZE));
+	int maxX = static_cast<int>(floor((aabb.left + aabb.width) / BROADPHASE_CELL_SIZE));
+	int maxY = static_cast<int>(floor((aabb.top + aabb.height) / BROADPHASE_CELL_SIZE));
+	minX = std::min(std::max(minX, 0), _cellsX - 1);
+	minY = std::min(std::max(minY, 0), _cellsY - 1);
+	maxX = std::min(std::max(maxX, 0), _cellsX - 1);
+	maxY = std::min(std::max(maxY, 0), _cellsY - 1);
+	return sf::IntRect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Broadphase::_addToCells(uint32_t id, const sf::IntRect& cells)
+{
+	for (int cy = cells.top; cy < cells.top + cells.height; cy++)
+		for (int cx = cells.left; cx < cells.left + cells.width; cx++)
+			_cells[cy * _cellsX + cx].push_back(id);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Broadphase::_removeFromCells(uint32_t id, const sf::IntRect& cells)
+{
+	for (int cy = cells.top; cy < cells.top + cells.height; cy++)
+		for (int cx = cells.left; cx < cells.left + cells.width; cx++)
+		{
+			std::vector<uint32_t>& cell = _cells[cy * _cellsX + cx];
+			cell.erase(std::remove(cell.begin(), cell.end(), id), cell.end());
+		};
+};
+
+}; // namespace Diamondek
\ No newline at end of file
@@ -0,0 +1,57 @@
+/*! 
+	\class Diamondek::Broadphase
+    \brief Broadphase class
+
+    Uniform grid of spritex AABBs. Used to find spritexes, which may collide with given one, without testing every spritex on the board.
+    Objects are EntityStore entities: their entries are indexed by slot number of the ID, so queries don't search for them.
+*/
+
+#ifndef _BROADPHASE_H_
+#define _BROADPHASE_H_
+
+#include <SFML/Graphics.hpp>
+#include "globals.h"
+#include "entitystore.h"
+
+// Size of the grid cell in pixels
+#define BROADPHASE_CELL_SIZE 64
+
+namespace Diamondek {
+
+class Broadphase
+{
+public:
+	Broadphase();
+	~Broadphase();
+	/// Add object 'id' with global AABB 'aabb' to the grid, or move it if it is already there
+	void update(uint32_t id, const sf::FloatRect& aabb);
+	/// Remove object 'id' from the grid
+	void remove(uint32_t id);
+	/// Remove all objects
+	void clear();
+	/// Fill 'result' with ids of objects, whose AABBs intersect 'aabb'. Ids are sorted in ascending order
+	void query(const sf::FloatRect& aabb, std::vector<uint32_t>& result) const;
+private:
+	class Entry {
+	public:
+		/// ID of the object, ENTITY_NONE if the slot has no object in the grid
+		uint32_t id;
+		/// Global AABB of the object
+		sf::FloatRect aabb;
+		/// Range of grid cells covered by 'aabb'
+		sf::IntRect cells;
+	};
+	/// Cells, each containing ids of objects, which overlap it. Objects out of the screen are clamped to the border cells
+	std::vector<std::vector<uint32_t> > _cells;
+	int _cellsX, _cellsY;
+	/// Objects in the grid, indexed by slot number of their IDs
+	std::vector<Entry> _entries;
+	/// Return range of cells covered by 'aabb'
+	sf::IntRect _cellRange(const sf::FloatRect& aabb) const;
+	void _addToCells(uint32_t id, const sf::IntRect& cells);
+	void _removeFromCells(uint32_t id, const sf::IntRect& cells);
+};
+
+}; // namespace Diamondek
+
+#endif // _BROADPHASE_H_
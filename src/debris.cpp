@@ -0,0 +1,283 @@
+/*!
+	\class Diamondek::DebrisFinder
+    \brief DebrisFinder class
+*/
+
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "debris.h"
+
+namespace Diamondek {
+
+/// Return index of the lowest set bit of non-zero 'v'
+static inline int _lowestSetBit(uint64_t v)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, v);
+	return static_cast<int>(idx);
+#else
+	return __builtin_ctzll(v);
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DebrisFinder::find(const Spritex& spritex, const sf::IntRect& damage, std::vector<Island>& islands)
+{
+	sf::Vector2i size(static_cast<int>(spritex.getSize().x), static_cast<int>(spritex.getSize().y));
+	sf::IntRect touch(damage.left - 1, damage.top - 1, damage.width + 2, damage.height + 2);
+	sf::IntRect required = damage; // floating components, which must be in the window
+	int margin = DEBRIS_SEARCH_MARGIN;
+	int left, top, right, bottom, label, n, f;
+	bool resolved;
+	Island island;
+
+	islands.clear();
+	const FloatingList& floating = _getFloating(spritex);
+	for (;;)
+	{
+		left = std::max(0, std::min(required.left, damage.left - margin));
+		top = std::max(0, std::min(required.top, damage.top - margin));
+		right = std::min(size.x, std::max(required.left + required.width, damage.left + damage.width + margin));
+		bottom = std::min(size.y, std::max(required.top + required.height, damage.top + damage.height + margin));
+		_window = sf::IntRect(left, top, right - left, bottom - top);
+		if ((_window.width <= 0) || (_window.height <= 0)) return;
+		_label(spritex, size);
+		n = static_cast<int>(_pixels.size());
+		_origin.assign(n, -1);
+		resolved = true;
+		for (label = 0; label < n; label++)
+		{
+			if ((_pixels[label] == 0) || _anchored[label]) continue;
+			const Run& first = _runs[_first[label]];
+			f = _origin[label] = _findFloating(floating, _window.left + first.x0, _window.top + first.y);
+			if (!_bounds[label].intersects(touch)) continue;
+			// Part of floating component is resolved, when all its parts are in the window, the others are when they are fully inside
+			if (f >= 0)
+			{
+				const sf::IntRect& b = floating[f].bounds;
+				if ((b.left >= left) && (b.top >= top) && (b.left + b.width <= right) && (b.top + b.height <= bottom)) continue;
+				required.width = std::max(required.left + required.width, b.left + b.width) - std::min(required.left, b.left);
+				required.height = std::max(required.top + required.height, b.top + b.height) - std::min(required.top, b.top);
+				required.left = std::min(required.left, b.left);
+				required.top = std::min(required.top, b.top);
+				resolved = false;
+			}
+			else if (_open[label]) resolved = false;
+		};
+		if (resolved || ((right - left == size.x) && (bottom - top == size.y))) break;
+		margin *= 2;
+	};
+	// The largest part of each floating component stays, parts of equal size are preferred in row order
+	_keep.assign(floating.size(), -1);
+	for (label = 0; label < n; label++)
+	{
+		f = _origin[label];
+		if ((f >= 0) && ((_keep[f] < 0) || (_pixels[label] > _pixels[_keep[f]]))) _keep[f] = label;
+	};
+	for (label = 0; label < n; label++)
+	{
+		if ((_pixels[label] == 0) || _anchored[label] || !_bounds[label].intersects(touch)) continue;
+		f = _origin[label];
+		if ((f >= 0) ? (_keep[f] == label) : _open[label]) continue;
+		island.bounds = _bounds[label];
+		island.pixels = _pixels[label];
+		island.label = label;
+		islands.push_back(island);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DebrisFinder::getIslandMask(const Island& island, std::vector<uint64_t>& selection) const
+{
+	const sf::IntRect& b = island.bounds;
+	int stride = (b.width + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+	int y, x;
+
+	selection.assign(stride * b.height, 0);
+	for (std::vector<Run>::const_iterator r = _runs.begin(); r != _runs.end(); ++r)
+	{
+		if (r->label != island.label) continue;
+		y = _window.top + r->y - b.top;
+		for (x = _window.left + r->x0 - b.left; x < _window.left + r->x1 - b.left; x++)
+			selection[y * stride + x / MASK_WORD_BITS] |= static_cast<uint64_t>(1) << (x % MASK_WORD_BITS);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+const DebrisFinder::FloatingList& DebrisFinder::_getFloating(const Spritex& spritex)
+{
+	sf::Vector2i size(static_cast<int>(spritex.getSize().x), static_cast<int>(spritex.getSize().y));
+	std::weak_ptr<const SpritexAsset> key(spritex.getAsset());
+	std::map<int, int> index; // floating component by root label
+	int n;
+
+	for (FloatingMap::iterator i = _floating.begin(); i != _floating.end(); )
+	{
+		if (i->first.expired()) _floating.erase(i++); else ++i;
+	};
+	FloatingMap::iterator found = _floating.find(key);
+	if (found != _floating.end()) return found->second;
+	FloatingList& floating = _floating[key];
+	_window = sf::IntRect(0, 0, size.x, size.y);
+	_label(*spritex.getAsset(), size);
+	n = static_cast<int>(_pixels.size());
+	for (int label = 0; label < n; label++)
+	{
+		if ((_pixels[label] == 0) || _anchored[label]) continue;
+		index[label] = static_cast<int>(floating.size());
+		floating.push_back(Floating());
+		floating.back().bounds = _bounds[label];
+	};
+	// The window is the whole image, so runs are in image coordinates already
+	for (std::vector<Run>::iterator r = _runs.begin(); r != _runs.end(); ++r)
+	{
+		std::map<int, int>::iterator f = index.find(r->label);
+		if (f != index.end()) floating[f->second].runs.push_back(*r);
+	};
+	return floating;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int DebrisFinder::_findFloating(const FloatingList& floating, int x, int y)
+{
+	std::vector<Run>::const_iterator r;
+	int n = static_cast<int>(floating.size());
+
+	for (int f = 0; f < n; f++)
+	{
+		if (!floating[f].bounds.contains(x, y)) continue;
+		// The first run, which doesn't end before the pixel
+		r = std::lower_bound(floating[f].runs.begin(), floating[f].runs.end(), sf::Vector2i(x, y), [](const Run& run, const sf::Vector2i& p)
+		{
+			return (run.y < p.y) || ((run.y == p.y) && (run.x1 <= p.x));
+		});
+		if ((r != floating[f].runs.end()) && (r->y == y) && (r->x0 <= x)) return f;
+	};
+	return -1;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Source> void DebrisFinder::_label(const Source& source, const sf::Vector2i& size)
+{
+	size_t prevStart = 0, rowStart = 0, p, q;
+	int label, n;
+
+	_runs.clear();
+	_parent.clear();
+	// Label runs row by row, joining each one with runs of the previous row, which touch it (diagonally too)
+	for (int y = 0; y < _window.height; y++)
+	{
+		rowStart = _runs.size();
+		_addRuns(source, y);
+		p = prevStart;
+		for (size_t r = rowStart; r < _runs.size(); r++)
+		{
+			Run& run = _runs[r];
+			// Runs of the previous row, which end before this one (and so before the next ones) starts, are passed
+			while ((p < rowStart) && (_runs[p].x1 < run.x0)) p++;
+			label = -1;
+			for (q = p; (q < rowStart) && (_runs[q].x0 <= run.x1); q++)
+			{
+				if (label < 0) label = _runs[q].label; else _join(label, _runs[q].label);
+			};
+			if (label < 0)
+			{
+				label = static_cast<int>(_parent.size());
+				_parent.push_back(label);
+			};
+			run.label = label;
+		};
+		prevStart = rowStart;
+	};
+	// Resolve labels to roots and gather components
+	n = static_cast<int>(_parent.size());
+	_bounds.assign(n, sf::IntRect());
+	_pixels.assign(n, 0);
+	_first.assign(n, 0);
+	_anchored.assign(n, false);
+	_open.assign(n, false);
+	for (std::vector<Run>::iterator r = _runs.begin(); r != _runs.end(); ++r)
+	{
+		r->label = label = _root(r->label);
+		sf::IntRect runRect(_window.left + r->x0, _window.top + r->y, r->x1 - r->x0, 1);
+		if (_pixels[label] == 0)
+		{
+			_bounds[label] = runRect;
+			_first[label] = static_cast<int>(r - _runs.begin());
+		}
+		else
+		{
+			sf::IntRect& b = _bounds[label];
+			int l = std::min(b.left, runRect.left);
+			b.width = std::max(b.left + b.width, runRect.left + runRect.width) - l;
+			b.left = l;
+			b.height = runRect.top + 1 - b.top;
+		};
+		_pixels[label] += r->x1 - r->x0;
+		if ((runRect.top == 0) || (runRect.top == size.y - 1) || (runRect.left == 0) || (runRect.left + runRect.width == size.x)) _anchored[label] = true;
+		if ((r->y == 0) || (r->y == _window.height - 1) || (r->x0 == 0) || (r->x1 == _window.width)) _open[label] = true;
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Source> void DebrisFinder::_addRuns(const Source& source, int y)
+{
+	int left = _window.left;
+	int right = _window.left + _window.width;
+	int lastWord = (right - 1) / MASK_WORD_BITS;
+	uint64_t bits;
+	int start, length, end;
+	Run run;
+
+	run.y = y;
+	run.label = -1;
+	for (int w = left / MASK_WORD_BITS; w <= lastWord; w++)
+	{
+		bits = source.getMaskWord(w, _window.top + y);
+		// Only columns of the window
+		if (w == left / MASK_WORD_BITS) bits &= ~static_cast<uint64_t>(0) << (left % MASK_WORD_BITS);
+		if ((w == lastWord) && (right % MASK_WORD_BITS != 0)) bits &= (static_cast<uint64_t>(1) << (right % MASK_WORD_BITS)) - 1;
+		while (bits != 0)
+		{
+			start = _lowestSetBit(bits);
+			length = (~(bits >> start) == 0) ? MASK_WORD_BITS - start : _lowestSetBit(~(bits >> start));
+			end = start + length;
+			bits = (end == MASK_WORD_BITS) ? 0 : bits & (~static_cast<uint64_t>(0) << end);
+			start += w * MASK_WORD_BITS - left;
+			end += w * MASK_WORD_BITS - left;
+			// Run, which goes on from the previous word
+			if ((start > 0) && !_runs.empty() && (_runs.back().y == y) && (_runs.back().x1 == start))
+			{
+				_runs.back().x1 = end;
+				continue;
+			};
+			run.x0 = start;
+			run.x1 = end;
+			_runs.push_back(run);
+		};
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int DebrisFinder::_root(int label)
+{
+	while (_parent[label] != label)
+	{
+		_parent[label] = _parent[_parent[label]];
+		label = _parent[label];
+	};
+	return label;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DebrisFinder::_join(int a, int b)
+{
+	a = _root(a);
+	b = _root(b);
+	if (a < b) _parent[b] = a; else _parent[a] = b;
+};
+
+}; // namespace Diamondek
\ No newline at end of file
@@ -0,0 +1,97 @@
+/*!
+	\class Diamondek::DebrisFinder
+    \brief DebrisFinder class
+
+    Finds islands of solid pixels cut off by damage. Horizontal runs of solid pixels in a window around the damaged region are labelled
+    as 8-connected components by union-find over the collision mask. Components, which reach the image border, are anchored. A component
+    reaching the window border inside the image may be anchored out of it, so the window is grown and searched again, until it is known.
+
+    Components of the pristine image, which don't reach its border (floating ones), are found once per asset. They were anchored as drawn,
+    so when one is split, its largest part stays and the others fall. Parts of the other components, which lost the image border, fall.
+*/
+
+#ifndef _DEBRIS_H_
+#define _DEBRIS_H_
+
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <memory>
+#include <vector>
+#include "spritex.h"
+
+// Solid pixels this far (pixels) around the damaged region are searched for islands first. Margin is doubled while some are not resolved
+#define DEBRIS_SEARCH_MARGIN 32
+// Islands smaller than this number of pixels crumble away instead of becoming debris
+#define DEBRIS_MIN_PIXELS 16
+
+namespace Diamondek {
+
+class DebrisFinder
+{
+public:
+	/// Island of solid pixels, not connected to anything
+	class Island {
+	public:
+		/// Bounding rectangle, local coordinates of spritex
+		sf::IntRect bounds;
+		/// Number of pixels
+		int pixels;
+		/// Label of island pixels
+		int label;
+	};
+	/// Label solid pixels of 'spritex' in 'damage' (local coordinates) grown by a margin, and fill 'islands' with components, which touch 'damage'
+	/// and are not anchored. Labels are kept until the next call
+	void find(const Spritex& spritex, const sf::IntRect& damage, std::vector<Island>& islands);
+	/// Fill 'selection' with mask of 'island' pixels: rows of 'island.bounds', one bit per pixel, padded to MASK_WORD_BITS (as Spritex collision mask)
+	void getIslandMask(const Island& island, std::vector<uint64_t>& selection) const;
+private:
+	/// Run of solid pixels in a window row
+	class Run {
+	public:
+		/// Window row and columns [x0, x1)
+		int y, x0, x1;
+		/// Label of run, root label after 'find' is done
+		int label;
+	};
+	/// Floating component of pristine image: bounds and runs (image coordinates, row by row, left to right)
+	class Floating {
+	public:
+		sf::IntRect bounds;
+		std::vector<Run> runs;
+	};
+	typedef std::vector<Floating> FloatingList;
+	typedef std::map<std::weak_ptr<const SpritexAsset>, FloatingList, std::owner_less<std::weak_ptr<const SpritexAsset> > > FloatingMap;
+	/// Return floating components of 'spritex' asset. Its whole image is labelled at the first call, so '_runs' are overwritten
+	const FloatingList& _getFloating(const Spritex& spritex);
+	/// Return index of component of 'floating', which has pixel 'x', 'y', or -1
+	static int _findFloating(const FloatingList& floating, int x, int y);
+	/// Label solid pixels of 'source' (Spritex or SpritexAsset) of 'size' in '_window' and gather components
+	template <class Source> void _label(const Source& source, const sf::Vector2i& size);
+	/// Append runs of window row 'y' of 'source' mask to '_runs'
+	template <class Source> void _addRuns(const Source& source, int y);
+	/// Return root label of 'label', halving the path to it
+	int _root(int label);
+	/// Join sets of labels 'a' and 'b'. Smaller root wins, so labelling is deterministic
+	void _join(int a, int b);
+	/// Searched region, local coordinates of spritex
+	sf::IntRect _window;
+	/// Runs of all window rows, row by row, left to right
+	std::vector<Run> _runs;
+	/// Union-find forest of labels
+	std::vector<int> _parent;
+	/// Bounds, pixel count, first run, image border contact and window border contact of components, by root label
+	std::vector<sf::IntRect> _bounds;
+	std::vector<int> _pixels;
+	std::vector<int> _first;
+	std::vector<bool> _anchored;
+	std::vector<bool> _open;
+	/// Floating component of each component (-1 if none), and the component, which stays of each floating one
+	std::vector<int> _origin;
+	std::vector<int> _keep;
+	/// Floating components by asset, entries of freed assets are dropped
+	FloatingMap _floating;
+};
+
+}; // namespace Diamondek
+
+#endif // _DEBRIS_H_
@@ -0,0 +1,124 @@
+/*! 
+	\class Diamondek::EntityStore
+    \brief EntityStore class
+*/
+
+#include "entitystore.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+EntityStore::EntityStore()
+{
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+EntityStore::~EntityStore()
+{
+	clear();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t EntityStore::add(const SpritexAssetPtr& asset, uint32_t flags)
+{
+	uint32_t slot;
+	Spritex* s;
+	if (_freeSlots.empty())
+	{
+		if (_slots.size() > ENTITY_SLOT_MASK) throw "Too many entities";
+		slot = static_cast<uint32_t>(_slots.size());
+		_slots.push_back(Slot());
+		_slots[slot].generation = 1;
+		_pool.emplace_back();
+	}
+	else
+	{
+		slot = _freeSlots.back();
+		_freeSlots.pop_back();
+	};
+	s = new (&_pool[slot]) Spritex(asset);
+	_slots[slot].index = size();
+	uint32_t id = (_slots[slot].generation << ENTITY_SLOT_BITS) | slot;
+	_ids.push_back(id);
+	_position.push_back(s->getPosition());
+	_prevPosition.push_back(s->getPosition());
+	_speed.push_back(sf::Vector2f(0, 0));
+	_accel.push_back(sf::Vector2f(0, 0));
+	_flags.push_back(flags);
+	_aabb.push_back(s->getGlobalAABB());
+	_pixels.push_back(s);
+	return id;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void EntityStore::clear()
+{
+	for (int i = 0; i < size(); i++) setDead(i);
+	removeDead();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void EntityStore::removeDead()
+{
+	int dst = 0;
+	uint32_t slot;
+	for (int src = 0; src < size(); src++)
+	{
+		slot = _ids[src] & ENTITY_SLOT_MASK;
+		if (isDead(src))
+		{ // free slot, next entity in it gets a new generation
+			_pixels[src]->~Spritex();
+			_slots[slot].index = -1;
+			_slots[slot].generation = ((_slots[slot].generation + 1) & ENTITY_SLOT_MASK) ? (_slots[slot].generation + 1) : 1;
+			_freeSlots.push_back(slot);
+			continue;
+		};
+		if (dst != src)
+		{
+			_ids[dst] = _ids[src];
+			_position[dst] = _position[src];
+			_prevPosition[dst] = _prevPosition[src];
+			_speed[dst] = _speed[src];
+			_accel[dst] = _accel[src];
+			_flags[dst] = _flags[src];
+			_aabb[dst] = _aabb[src];
+			_pixels[dst] = _pixels[src];
+			_slots[slot].index = dst;
+		};
+		dst++;
+	};
+	_ids.resize(dst);
+	_position.resize(dst);
+	_prevPosition.resize(dst);
+	_speed.resize(dst);
+	_accel.resize(dst);
+	_flags.resize(dst);
+	_aabb.resize(dst);
+	_pixels.resize(dst);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int EntityStore::indexOf(uint32_t id) const
+{
+	uint32_t slot = id & ENTITY_SLOT_MASK;
+	if (slot >= _slots.size()) return -1;
+	if (_slots[slot].generation != (id >> ENTITY_SLOT_BITS)) return -1; // stale ID
+	return _slots[slot].index;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void EntityStore::setPosition(int i, const sf::Vector2f& position)
+{
+	_position[i] = position;
+	_pixels[i]->setPosition(position);
+	_aabb[i] = _pixels[i]->getGlobalAABB();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void EntityStore::physicsTick(int i)
+{
+	_speed[i] += _accel[i];
+	setPosition(i, _position[i] + _speed[i]);
+};
+
+}; // namespace Diamondek
\ No newline at end of file
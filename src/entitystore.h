@@ -0,0 +1,121 @@
+/*! 
+	\class Diamondek::EntityStore
+    \brief EntityStore class
+
+    Storage of board entities. State used by physics (position, speed, acceleration, flags and AABB) is kept in dense arrays,
+    so processing all entities is a linear sweep. Pixel data of entities (spritexes) is kept in a separate pool indexed by slot: spritexes are
+    constructed there in place and destroyed by the store, they never move, so pointers to them stay valid while the entity lives.
+    Entities are addressed by generational IDs: ID of a removed entity never matches an entity added later.
+*/
+
+#ifndef _ENTITYSTORE_H_
+#define _ENTITYSTORE_H_
+
+#include <SFML/Graphics.hpp>
+#include <deque>
+#include <type_traits>
+#include "spritex.h"
+
+// Low bits of entity ID are the slot number, high bits are the slot generation
+#define ENTITY_SLOT_BITS 16
+#define ENTITY_SLOT_MASK ((1 << ENTITY_SLOT_BITS) - 1)
+// ID, which never matches any entity
+#define ENTITY_NONE 0
+
+namespace Diamondek {
+
+/// Types of entities:
+/// DYNAMIC: entity can move, and therefore must be checked for collisions with other entities
+/// DESTRUCTIBLE: entity can be destroyed
+/// DIAMOND: diamond object disappears, when collided with paddle, thus increasing paddle energy
+/// DEAD: entity will be removed at the end of the tick
+/// SLEEPING: dynamic entity is at rest, it's not moved and not checked for collisions until it is woken up
+/// DEBRIS: piece of destructible entity, which was cut off by explosion and falls
+typedef enum { efNone = 0, efDynamic = 1, efDestructible = 2, efDiamond = 4, efDead = 8, efSleeping = 16, efDebris = 32 } entityFlags;
+
+class EntityStore
+{
+public:
+	EntityStore();
+	~EntityStore();
+	/// Add entity with pixel data made of 'asset' and return its ID
+	uint32_t add(const SpritexAssetPtr& asset, uint32_t flags);
+	/// Remove all entities
+	void clear();
+	/// Remove entities marked as dead. Order of remaining entities is preserved
+	void removeDead();
+	/// Return index of entity 'id' in dense arrays, or -1 if there is no such entity
+	int indexOf(uint32_t id) const;
+	/// Return pixel data of entity 'id', or NULL if there is no such entity
+	Spritex* getSpritex(uint32_t id) const { int i = indexOf(id); return (i < 0) ? NULL : _pixels[i]; };
+	/// Number of entities
+	int size() const { return static_cast<int>(_ids.size()); };
+	//
+	// Access to entity by its index in dense arrays
+	//
+	uint32_t getID(int i) const { return _ids[i]; };
+	Spritex* getPixels(int i) const { return _pixels[i]; };
+	const sf::Vector2f& getPosition(int i) const { return _position[i]; };
+	/// Move entity and update its AABB
+	void setPosition(int i, const sf::Vector2f& position);
+	/// Put entity to 'position' at once, e.g. when it appears: it's not interpolated from the previous position
+	void teleport(int i, const sf::Vector2f& position) { setPosition(i, position); _prevPosition[i] = position; };
+	/// Remember current positions of all entities as positions of the previous tick
+	void savePositions() { _prevPosition = _position; };
+	/// Return position interpolated between the previous and the current tick. 'alpha' is in range [0, 1]
+	sf::Vector2f getRenderPosition(int i, float alpha) const { return _prevPosition[i] + (_position[i] - _prevPosition[i]) * alpha; };
+	const sf::Vector2f& getSpeed(int i) const { return _speed[i]; };
+	void setSpeed(int i, const sf::Vector2f& speed) { if (isDynamic(i)) _speed[i] = speed; };
+	/// Permanent force applied to entity
+	const sf::Vector2f& getAcceleration(int i) const { return _accel[i]; };
+	/// Global AABB of entity
+	const sf::FloatRect& getAABB(int i) const { return _aabb[i]; };
+	uint32_t getFlags(int i) const { return _flags[i]; };
+	bool isDynamic(int i) const { return (_flags[i] & efDynamic) != 0; };
+	bool isDestructible(int i) const { return (_flags[i] & efDestructible) != 0; };
+	bool isDiamond(int i) const { return (_flags[i] & efDiamond) != 0; };
+	bool isDead(int i) const { return (_flags[i] & efDead) != 0; };
+	bool isDebris(int i) const { return (_flags[i] & efDebris) != 0; };
+	void setDead(int i) { _flags[i] |= efDead; };
+	bool isSleeping(int i) const { return (_flags[i] & efSleeping) != 0; };
+	void setSleeping(int i, bool sleeping) { if (sleeping) _flags[i] |= efSleeping; else _flags[i] &= ~efSleeping; };
+	//
+	// Trivial physics
+	// It's assumed that a physic tick has fixed dt
+	//
+	/// Apply permanent force to entity
+	void applyForce(int i, const sf::Vector2f& force) { _accel[i] += force; };
+	/// Apply force only for one tick
+	void applyImpulseOfForce(int i, const sf::Vector2f& force) { _speed[i] += force; };
+	/// Calculate and move entity to the new position according to current speed and applied forces
+	void physicsTick(int i);
+private:
+	class Slot {
+	public:
+		/// Generation of entity, which occupies (or occupied last) this slot
+		uint32_t generation;
+		/// Index in dense arrays, -1 if slot is free
+		int index;
+	};
+	std::vector<Slot> _slots;
+	std::vector<uint32_t> _freeSlots;
+	//
+	// Dense arrays, all of the same size
+	//
+	std::vector<uint32_t> _ids;
+	std::vector<sf::Vector2f> _position;
+	/// Positions at the beginning of the current tick, used for render interpolation
+	std::vector<sf::Vector2f> _prevPosition;
+	std::vector<sf::Vector2f> _speed;
+	std::vector<sf::Vector2f> _accel;
+	std::vector<uint32_t> _flags;
+	std::vector<sf::FloatRect> _aabb;
+	/// Spritexes of entities, in the pool entries of their slots
+	std::vector<Spritex*> _pixels;
+	/// Pool of pixel data, one entry per slot. Entries of free slots hold no spritex. Deque grows by blocks, so entries never move
+	std::deque<std::aligned_storage<sizeof(Spritex), alignof(Spritex)>::type> _pool;
+};
+
+}; // namespace Diamondek
+
+#endif // _ENTITYSTORE_H_
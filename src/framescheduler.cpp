@@ -0,0 +1,67 @@
+/*!
+	\class Diamondek::FrameScheduler
+    \brief FrameScheduler class
+*/
+
+#include <stdio.h>
+#include "framescheduler.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+FrameScheduler::FrameScheduler(sf::RenderWindow& window, const std::string& name)
+{
+	_window = &window;
+	_name = name;
+	_redraw = true;
+	_animating = false;
+	_nextFrame = sf::Time::Zero;
+	_framePeriod = sf::microseconds(1000000 / FRAME_RATE_MAX);
+	_frames = 0;
+	_cpuStart = clock();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+FrameScheduler::~FrameScheduler()
+{
+#ifdef DEBUG_FRAME_STATS
+	fprintf(stderr, "%s: %u frames, %.3f s CPU in %.3f s\n", _name.c_str(), _frames, getCPUTime(), getWallTime());
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool FrameScheduler::waitEvent(sf::Event& event)
+{
+	sf::Time now;
+
+	if (_window->pollEvent(event))
+	{
+		_checkEvent(event);
+		return true;
+	};
+	if (!_redraw && !_animating)
+	{ // Nothing to draw until something happens
+		if (!_window->waitEvent(event)) return false; // window is closed
+		_checkEvent(event);
+		return true;
+	};
+	now = _clock.getElapsedTime();
+	if (now < _nextFrame) sf::sleep(_nextFrame - now);
+	return false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void FrameScheduler::frameDone()
+{
+	_redraw = false;
+	_frames++;
+	_nextFrame = _clock.getElapsedTime() + _framePeriod;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void FrameScheduler::_checkEvent(const sf::Event& event)
+{
+	if ((event.type == sf::Event::GainedFocus) || (event.type == sf::Event::Resized)) _redraw = true;
+};
+
+}; // namespace Diamondek
\ No newline at end of file
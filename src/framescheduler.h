@@ -0,0 +1,69 @@
+/*!
+	\class Diamondek::FrameScheduler
+    \brief FrameScheduler class
+
+    Frame pacing shared by all screens. Screen is redrawn only when it requested redraw (its state changed) or while it is animating,
+    and not more often than FRAME_RATE_MAX. The rest of time the thread sleeps until the next event or frame, so idle screens don't load CPU.
+    Typical screen loop:
+        while (running)
+        {
+            while (scheduler.waitEvent(event)) { handle event, call invalidate() if something changed };
+            if (!scheduler.frameDue()) continue;
+            draw;
+            scheduler.frameDone();
+        };
+*/
+
+#ifndef _FRAMESCHEDULER_H_
+#define _FRAMESCHEDULER_H_
+
+#include <SFML/Graphics.hpp>
+#include <string>
+#include <time.h>
+#include "globals.h"
+
+namespace Diamondek {
+
+class FrameScheduler
+{
+public:
+	/// Schedule frames of screen 'name' shown in 'window'. First frame is drawn at once
+	FrameScheduler(sf::RenderWindow& window, const std::string& name);
+	/// Report CPU time used while screen was shown (if DEBUG_FRAME_STATS is defined)
+	~FrameScheduler();
+	/// Request redraw of the screen
+	void invalidate() { _redraw = true; };
+	/// Redraw screen every frame while 'animating' is true
+	void setAnimating(bool animating) { _animating = animating; };
+	bool isAnimating() const { return _animating; };
+	/// Return next event in 'event' and true. If there are no events, sleep until the next one or until frame is due, whatever comes first, and return false when frame is due.
+	/// When nothing needs to be drawn, it waits for events only
+	bool waitEvent(sf::Event& event);
+	/// Return true if frame should be drawn now
+	bool frameDue() const { return (_redraw || _animating) && (_clock.getElapsedTime() >= _nextFrame); };
+	/// Call after frame is drawn
+	void frameDone();
+	/// Return number of frames drawn
+	uint32_t getFrames() const { return _frames; };
+	/// Return seconds of process CPU time and wall time since screen was shown
+	float getCPUTime() const { return static_cast<float>(clock() - _cpuStart) / CLOCKS_PER_SEC; };
+	float getWallTime() const { return _clock.getElapsedTime().asSeconds(); };
+private:
+	/// Request redraw on events, after which window contents may be lost
+	void _checkEvent(const sf::Event& event);
+	sf::RenderWindow* _window;
+	std::string _name;
+	bool _redraw;
+	bool _animating;
+	/// Time since screen was shown
+	sf::Clock _clock;
+	/// Time of the next frame, by '_clock'
+	sf::Time _nextFrame;
+	sf::Time _framePeriod;
+	uint32_t _frames;
+	clock_t _cpuStart;
+};
+
+}; // namespace Diamondek
+
+#endif // _FRAMESCHEDULER_H_
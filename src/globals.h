@@ -3,6 +3,8 @@
 */
 //#undef DEBUG_RENDER
 #define DEBUG_RENDER
+// Uncomment to report frames and CPU time of every screen to stderr, when it is closed
+//#define DEBUG_FRAME_STATS
 
 #define RESOLUTION_X 800
 #define RESOLUTION_Y 600
@@ -24,7 +26,26 @@
 #define PAUSED_FONT_SIZE 100
 
 // Update 300 times per second
-#define UPDATE_PERIOD_MSEC (1000 / 300)
+#define UPDATE_RATE 300
+#define UPDATE_PERIOD_USEC (1000000 / UPDATE_RATE)
+// Max number of updates to catch up in one frame. If rendering is slower, game slows down instead of stalling
+#define MAX_CATCHUP_TICKS 30
+// Frames are not rendered more often than this, the rest of time main loop sleeps
+#define FRAME_RATE_MAX 120
+// Levels description file
+#define LEVELS_FILE "data/levels.json"
+// Preprocessed levels and images (see tools/levelpack.cpp). If it is missing or made of another LEVELS_FILE, LEVELS_FILE and images are loaded instead
+#define LEVEL_PACK_FILE "data/levels.pack"
+// Images of base resources, loaded for every level
+#define BOARD_IMAGE "data/board.png"
+#define BOARD_DENSITY_IMAGE "data/board_density.png"
+#define BALL_IMAGE "data/ball.png"
+#define PADDLE_IMAGE "data/paddle.png"
+// Gem image file is GEM_IMAGE_PREFIX + gem index + GEM_IMAGE_SUFFIX
+#define GEM_IMAGE_PREFIX "data/gem"
+#define GEM_IMAGE_SUFFIX ".png"
+// Random generator seed of headless runs, unless another one is given
+#define RNG_SEED_DEFAULT 1
 // Speed defined in pixels per update period
 #define PADDLE_SPEED 4.0f
 #define BALL_SPEED 1.4f
@@ -33,6 +54,16 @@
 
 // G-force, applied to some objects (diamonds for example)
 #define G_ACCELERATION 0.001f
+// Sleeping gem is woken up by changes this close (pixels) to its sides and bottom
+#define GEM_SUPPORT_MARGIN 1.0f
+// Falling bodies are tested for collisions in parallel, when there are at least this many of them awake
+#define PARALLEL_MIN_BODIES 32
+
+// Swept collision: contact position precision in pixels
+#define SWEEP_PRECISION 0.1f
+// Swept collision: first step back (pixels) and max number of steps, when spritex is stuck at the start of its motion
+#define SWEEP_MIN_STEP 0.5f
+#define SWEEP_MAX_STEPS 12
 
 // Damping ratio
 #define DAMPING_RATIO_SQUARE 0.2f
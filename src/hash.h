@@ -0,0 +1,35 @@
+/*! 
+    \brief Hash functions
+
+    FNV-1a hash, used for simulation state hashing.
+*/
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_INIT 14695981039346656037ULL
+#define HASH_PRIME 1099511628211ULL
+
+namespace Diamondek {
+
+/// Continue hash 'h' with 'size' bytes of 'data'
+inline uint64_t hashBytes(uint64_t h, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= bytes[i];
+		h *= HASH_PRIME;
+	};
+	return h;
+};
+
+/// Continue hash 'h' with value 'v'
+template <typename T> inline uint64_t hashValue(uint64_t h, const T& v) { return hashBytes(h, &v, sizeof(v)); };
+
+}; // namespace Diamondek
+
+#endif // _HASH_H_
@@ -9,7 +9,7 @@
 
 namespace Diamondek {
 
-Help::Help(sf::RenderWindow &gameWindow)
+Help::Help(sf::RenderWindow &gameWindow) : _scheduler(gameWindow, "help")
 {
 	_gameWindow = &gameWindow;
 };
@@ -24,24 +24,31 @@ void Help::loadResources()
 	_bkg.setTexture(_bkgImage);
 };
 
-void Help::waitForEvent()
+bool Help::waitForEvent()
 {
     sf::Event Event;
-    while (_gameWindow->waitEvent(Event))
-    {
-		switch(Event.type)
+	while (_gameWindow->isOpen())
+	{
+		while (_scheduler.waitEvent(Event))
 		{
-			case sf::Event::Closed:
-			case sf::Event::KeyPressed:
-				return;
-				break;
+			switch(Event.type)
+			{
+				case sf::Event::Closed:
+					return false;
+				case sf::Event::KeyPressed:
+					return true;
+					break;
+			};
 		};
+		if (!_scheduler.frameDue()) continue;
+		draw();
+		_scheduler.frameDone();
 	};
+	return false;
 };
 
 void Help::run()
 {
-	draw();
 	waitForEvent();
 };
 
@@ -10,6 +10,7 @@
 #define _HELP_H_
 
 #include <SFML/Graphics.hpp>
+#include "framescheduler.h"
 
 namespace Diamondek {
 
@@ -20,12 +21,15 @@ public:
 	~Help();
 	void loadResources();
 	void run();
-	void waitForEvent();
+	/// Wait for key press or window close, redrawing screen if needed. Return true on key press
+	bool waitForEvent();
 	void draw();
 private:
 	sf::Texture _bkgImage;
 	sf::Sprite _bkg;
 	sf::RenderWindow* _gameWindow;
+	/// Static screen, drawn once and redrawn only if window contents are lost
+	FrameScheduler _scheduler;
 };
 
 }; // namespace Diamondek
@@ -0,0 +1,80 @@
+/*!
+	\class Diamondek::Hud
+    \brief Hud class
+*/
+
+#include <stdio.h>
+#include "hud.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Hud::Hud()
+{
+	_valid = false;
+	_gemsGained = 0;
+	_gemsTotal = 0;
+	_lives = 0;
+	_paused = false;
+	_buffer[0] = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Hud::setFont(const sf::Font& font)
+{
+	_sNumGems.setFont(font);
+	_sNumGems.setPosition(GEMS_TEXT_X, GEMS_TEXT_Y);
+	_sNumGems.setScale(0.5, 0.5);
+	_sNumLives.setFont(font);
+	_sNumLives.setPosition(LIVES_TEXT_X, LIVES_TEXT_Y);
+	_sNumLives.setScale(0.5, 0.5);
+	_sLevelInfo.setFont(font);
+	_sLevelInfo.setPosition(LEVEL_INFO_TEXT_X, LEVEL_INFO_TEXT_Y);
+	_sLevelInfo.setScale(0.5, 0.5);
+	_sPaused.setFont(font);
+	_sPaused.setString("Paused");
+	_sPaused.setCharacterSize(PAUSED_FONT_SIZE);
+	_sPaused.setPosition((RESOLUTION_X - _sPaused.getGlobalBounds().width) / 2, RESOLUTION_Y - PAUSED_FONT_SIZE * 1.5);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Hud::update(int gemsGained, int gemsTotal, int lives, const std::string& levelInfo, bool paused)
+{
+	bool changed = !_valid || (paused != _paused);
+
+	if (!_valid || (gemsGained != _gemsGained) || (gemsTotal != _gemsTotal))
+	{
+		_gemsGained = gemsGained;
+		_gemsTotal = gemsTotal;
+		snprintf(_buffer, HUD_TEXT_SIZE, "%d/%d", gemsGained, gemsTotal);
+		_sNumGems.setString(_buffer);
+		changed = true;
+	};
+	if (!_valid || (lives != _lives))
+	{
+		_lives = lives;
+		snprintf(_buffer, HUD_TEXT_SIZE, "%d", lives);
+		_sNumLives.setString(_buffer);
+		changed = true;
+	};
+	if (!_valid || (levelInfo != _levelInfo))
+	{
+		_levelInfo = levelInfo;
+		_sLevelInfo.setString(levelInfo);
+		changed = true;
+	};
+	_paused = paused;
+	_valid = true;
+	return changed;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Hud::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+	target.draw(_sNumGems, states);
+	target.draw(_sNumLives, states);
+	target.draw(_sLevelInfo, states);
+	if (_paused) target.draw(_sPaused, states);
+};
+
+}; // namespace Diamondek
\ No newline at end of file
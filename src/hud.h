@@ -0,0 +1,47 @@
+/*!
+	\class Diamondek::Hud
+    \brief Hud class
+
+    Texts shown over the board: collected gems, lives, level info and pause notice. Shown values are remembered, and a text is rebuilt
+    (SFML recreates its glyph geometry on every setString) only when its value changes. Numbers are formatted into fixed buffers.
+*/
+
+#ifndef _HUD_H_
+#define _HUD_H_
+
+#include <SFML/Graphics.hpp>
+#include <string>
+#include "globals.h"
+
+// Size of buffers for formatted numbers, enough for "-2147483648/-2147483648"
+#define HUD_TEXT_SIZE 32
+
+namespace Diamondek {
+
+class Hud : public sf::Drawable
+{
+public:
+	Hud();
+	/// Set font of all texts and place them
+	void setFont(const sf::Font& font);
+	/// Show these values. Return true if anything shown has changed
+	bool update(int gemsGained, int gemsTotal, int lives, const std::string& levelInfo, bool paused);
+	virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+private:
+	sf::Text _sNumGems;
+	sf::Text _sNumLives;
+	sf::Text _sLevelInfo;
+	sf::Text _sPaused;
+	/// Values shown now. Texts are empty until the first update
+	bool _valid;
+	int _gemsGained;
+	int _gemsTotal;
+	int _lives;
+	std::string _levelInfo;
+	bool _paused;
+	char _buffer[HUD_TEXT_SIZE];
+};
+
+}; // namespace Diamondek
+
+#endif // _HUD_H_
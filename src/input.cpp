@@ -0,0 +1,135 @@
+/*! 
+	\class Diamondek::InputScript
+    \brief InputScript class
+*/
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "globals.h"
+#include "input.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+InputScript::InputScript()
+{
+	clear();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+InputScript::~InputScript()
+{
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool InputScript::loadFromFile(const std::string& filename)
+{
+	std::ifstream scriptFile(filename.c_str(), std::ifstream::in);
+	std::string line, field, keys;
+	uint32_t tick, input;
+
+	if (!scriptFile.is_open()) return false;
+	clear();
+	while (std::getline(scriptFile, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		if (!(fields >> field)) continue;
+		if (field == "level")
+		{
+			if (!(fields >> _level)) return false;
+			continue;
+		};
+		if (field == "seed")
+		{
+			if (!(fields >> _seed)) return false;
+			continue;
+		};
+		if (field == "hash")
+		{
+			if (!(fields >> tick >> keys)) return false;
+			setHash(tick, strtoull(keys.c_str(), NULL, 16));
+			continue;
+		};
+		tick = strtoul(field.c_str(), NULL, 10);
+		if (!(fields >> keys)) return false;
+		input = inNone;
+		for (std::string::iterator c = keys.begin(); c != keys.end(); ++c)
+		{
+			switch (*c)
+			{
+				case 'L': case 'l': input |= inLeft; break;
+				case 'R': case 'r': input |= inRight; break;
+				case 'S': case 's': input |= inLaunch; break;
+				case 'P': case 'p': input |= inPause; break;
+				case 'N': case 'n': input |= inNextLevel; break;
+				case 'B': case 'b': input |= inPrevLevel; break;
+				case '-': break;
+				default: return false;
+			};
+		};
+		setInput(tick, input);
+	};
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool InputScript::saveToFile(const std::string& filename) const
+{
+	std::ofstream scriptFile(filename.c_str(), std::ofstream::out | std::ofstream::trunc);
+	char hex[17];
+
+	if (!scriptFile.is_open()) return false;
+	scriptFile << "level " << _level << "\n";
+	scriptFile << "seed " << _seed << "\n";
+	for (std::map<uint32_t, uint32_t>::const_iterator i = _changes.begin(); i != _changes.end(); ++i)
+	{
+		scriptFile << i->first << " ";
+		if (i->second == inNone) scriptFile << "-";
+		if (i->second & inLeft) scriptFile << "L";
+		if (i->second & inRight) scriptFile << "R";
+		if (i->second & inLaunch) scriptFile << "S";
+		if (i->second & inPause) scriptFile << "P";
+		if (i->second & inNextLevel) scriptFile << "N";
+		if (i->second & inPrevLevel) scriptFile << "B";
+		scriptFile << "\n";
+	};
+	for (std::map<uint32_t, uint64_t>::const_iterator i = _hashes.begin(); i != _hashes.end(); ++i)
+	{
+		snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(i->second));
+		scriptFile << "hash " << i->first << " " << hex << "\n";
+	};
+	return scriptFile.good();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void InputScript::clear()
+{
+	_changes.clear();
+	_hashes.clear();
+	_level = 1;
+	_seed = RNG_SEED_DEFAULT;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t InputScript::getInput(uint32_t tick) const
+{
+	// Find the last change at or before 'tick'
+	std::map<uint32_t, uint32_t>::const_iterator i = _changes.upper_bound(tick);
+	if (i == _changes.begin()) return inNone;
+	--i;
+	return i->second;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool InputScript::getHash(uint32_t tick, uint64_t& hash) const
+{
+	std::map<uint32_t, uint64_t>::const_iterator i = _hashes.find(tick);
+	if (i == _hashes.end()) return false;
+	hash = i->second;
+	return true;
+};
+
+}; // namespace Diamondek
\ No newline at end of file
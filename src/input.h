@@ -0,0 +1,64 @@
+/*! 
+	\class Diamondek::InputScript
+    \brief InputScript class
+
+    Player input, sampled once per simulation tick, and scripted input for headless runs.
+    Recorded game is a script with starting level, random seed and state hash of every tick, so it can be replayed and verified.
+*/
+
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <string>
+#include <map>
+#include <stdint.h>
+
+namespace Diamondek {
+
+/// Input state of one tick. inPause toggles pause, when it appears (not while it is held).
+/// inNextLevel and inPrevLevel are debug cheats, they are recorded too, so that recordings with them replay
+typedef enum { inNone = 0, inLeft = 1, inRight = 2, inLaunch = 4, inPause = 8, inNextLevel = 16, inPrevLevel = 32 } inputFlags;
+
+class InputScript
+{
+public:
+	InputScript();
+	~InputScript();
+	/// Load script from text file. Each line is "<tick> <keys>", where keys is a combination of letters L (left), R (right), S (space, launch), P (pause),
+	/// N (next level cheat), B (previous level cheat), or '-' for no keys. Input holds until the next line. Lines starting with '#' are comments.
+	/// Recordings also have lines "level <n>", "seed <n>" and "hash <tick> <hex>"
+	bool loadFromFile(const std::string& filename);
+	/// Save script to text file in the format of loadFromFile
+	bool saveToFile(const std::string& filename) const;
+	/// Remove all input, hashes, and reset level and seed
+	void clear();
+	/// Return input of tick 'tick'
+	uint32_t getInput(uint32_t tick) const;
+	/// Input changes to 'input' at tick 'tick'
+	void setInput(uint32_t tick, uint32_t input) { _changes[tick] = input; };
+	/// Set state hash after tick 'tick'
+	void setHash(uint32_t tick, uint64_t hash) { _hashes[tick] = hash; };
+	/// Return true and state hash after tick 'tick' in 'hash', if it is recorded
+	bool getHash(uint32_t tick, uint64_t& hash) const;
+	/// Return number of recorded ticks (ticks with hashes)
+	uint32_t getLength() const { return _hashes.empty() ? 0 : _hashes.rbegin()->first + 1; };
+	/// Starting level of recording
+	void setLevel(uint32_t level) { _level = level; };
+	uint32_t getLevel() const { return _level; };
+	/// Random generator seed of recording
+	void setSeed(uint32_t seed) { _seed = seed; };
+	uint32_t getSeed() const { return _seed; };
+private:
+	/// Input changes by tick number
+	std::map<uint32_t, uint32_t> _changes;
+	/// State hashes by tick number
+	std::map<uint32_t, uint64_t> _hashes;
+	/// Starting level
+	uint32_t _level;
+	/// Random generator seed
+	uint32_t _seed;
+};
+
+}; // namespace Diamondek
+
+#endif // _INPUT_H_
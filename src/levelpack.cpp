@@ -0,0 +1,156 @@
+/*!
+	\class Diamondek::LevelPack
+    \brief LevelPack class
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+#include <fstream>
+#include "levelpack.h"
+#include "assetcache.h"
+#include "hash.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+LevelPack::LevelPack()
+{
+	_data = NULL;
+	_size = 0;
+#ifdef _WIN32
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = NULL;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+LevelPack::~LevelPack()
+{
+	close();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool LevelPack::open(const std::string& filename, const std::string& levelsFile)
+{
+	uint64_t levelsHash;
+
+	close();
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (_file == INVALID_HANDLE_VALUE) return false;
+	if (!GetFileSizeEx(_file, &size) || (size.QuadPart < static_cast<LONGLONG>(sizeof(PackHeader))))
+	{
+		close();
+		return false;
+	};
+	_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mapping == NULL)
+	{
+		close();
+		return false;
+	};
+	_data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (_data == NULL)
+	{
+		close();
+		return false;
+	};
+	_size = static_cast<size_t>(size.QuadPart);
+#else
+	struct stat st;
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	if ((fstat(fd, &st) != 0) || (st.st_size < static_cast<off_t>(sizeof(PackHeader))))
+	{
+		::close(fd);
+		return false;
+	};
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // mapping stays valid
+	if (data == MAP_FAILED) return false;
+	_data = static_cast<const uint8_t*>(data);
+	_size = static_cast<size_t>(st.st_size);
+#endif
+	// Validate header and tables, pixel data offsets of images are checked too, so accessors don't need to
+	const PackHeader* h = _header();
+	bool valid = (h->magic == LEVEL_PACK_MAGIC) && (h->version == LEVEL_PACK_VERSION) && (h->size == _size) &&
+		(levelsFile.empty() || !hashFile(levelsFile, levelsHash) || (h->levelsHash == levelsHash)) &&
+		_inside(h->imagesOffset, h->imageCount, sizeof(PackImage)) &&
+		_inside(h->levelsOffset, h->levelCount, sizeof(PackLevel)) &&
+		_inside(h->gemsOffset, h->gemCount, sizeof(PackGem));
+	for (uint32_t i = 0; valid && (i < h->imageCount); i++)
+	{
+		const PackImage* image = getImage(i);
+		uint64_t pixels = static_cast<uint64_t>(image->width) * image->height;
+		valid = (image->tileColumns == (image->width + SPRITEX_TILE_SIZE - 1) / SPRITEX_TILE_SIZE) &&
+			(image->tileRows == (image->height + SPRITEX_TILE_SIZE - 1) / SPRITEX_TILE_SIZE) &&
+			(image->tilesOffset % sizeof(uint64_t) == 0) &&
+			(image->pixelmap[LEVEL_PACK_NAME_SIZE - 1] == 0) && (image->densitymap[LEVEL_PACK_NAME_SIZE - 1] == 0) &&
+			_inside(image->rgbaOffset, pixels, 4) &&
+			_inside(image->tilesOffset, static_cast<uint64_t>(image->tileColumns) * image->tileRows, sizeof(SpritexTile));
+	};
+	for (uint32_t i = 0; valid && (i < h->levelCount); i++)
+	{
+		const PackLevel* level = getLevel(i + 1);
+		valid = (level->imageIndex < h->imageCount) && (level->firstGem <= h->gemCount) && (level->gemCount <= h->gemCount - level->firstGem) &&
+			(level->code[LEVEL_PACK_CODE_SIZE - 1] == 0);
+	};
+	if (!valid) close();
+	return valid;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void LevelPack::close()
+{
+#ifdef _WIN32
+	if (_data != NULL) UnmapViewOfFile(_data);
+	if (_mapping != NULL) CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+	_mapping = NULL;
+	_file = INVALID_HANDLE_VALUE;
+#else
+	if (_data != NULL) munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+	_data = NULL;
+	_size = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+const PackLevel* LevelPack::getLevel(int levelNum) const
+{
+	if ((levelNum <= 0) || (static_cast<uint32_t>(levelNum) > _header()->levelCount)) return NULL;
+	return reinterpret_cast<const PackLevel*>(_data + _header()->levelsOffset) + (levelNum - 1);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool LevelPack::hashFile(const std::string& filename, uint64_t& hash)
+{
+	std::ifstream file(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+	char buffer[4096];
+
+	if (!file.is_open()) return false;
+	hash = HASH_INIT;
+	while (file.read(buffer, sizeof(buffer)) || (file.gcount() > 0)) hash = hashBytes(hash, buffer, static_cast<size_t>(file.gcount()));
+	return !file.bad();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+const PackImage* LevelPack::findImage(const std::string& pixelmap, const std::string& densitymap) const
+{
+	for (uint32_t i = 0; i < _header()->imageCount; i++)
+	{
+		const PackImage* image = getImage(i);
+		if ((pixelmap == image->pixelmap) && (densitymap == image->densitymap)) return image;
+	};
+	return NULL;
+};
+
+}; // namespace Diamondek
\ No newline at end of file
@@ -0,0 +1,122 @@
+/*!
+	\class Diamondek::LevelPack
+    \brief LevelPack class
+
+    Binary level pack: levels description and all images used by the game, with precomputed tiles (density, collision mask and summary) and raw RGBA pixels.
+    Pack is produced offline by tools/levelpack.cpp from levels.json and images, and is memory-mapped by the game, so no images are decoded during play.
+    Layout (little-endian): PackHeader, PackImage table, PackLevel table, PackGem table, then pixel data blocks aligned to LEVEL_PACK_ALIGN.
+    Pack remembers hash of levels file it was made of, and is not opened with another one, so an edited levels file is never overridden by a stale pack.
+*/
+
+#ifndef _LEVELPACK_H_
+#define _LEVELPACK_H_
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// "DMKP"
+#define LEVEL_PACK_MAGIC 0x504B4D44
+// Increase on any layout change, old packs are rejected
+#define LEVEL_PACK_VERSION 3
+#define LEVEL_PACK_NAME_SIZE 64
+#define LEVEL_PACK_CODE_SIZE 16
+#define LEVEL_PACK_ALIGN 16
+
+namespace Diamondek {
+
+struct SpritexTile;
+
+struct PackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t imageCount;
+	uint32_t levelCount;
+	uint32_t gemCount;
+	uint32_t reserved;
+	/// Offsets of tables from the beginning of pack
+	uint64_t imagesOffset;
+	uint64_t levelsOffset;
+	uint64_t gemsOffset;
+	/// Size of pack file
+	uint64_t size;
+	/// Hash of levels file the pack was made of (see LevelPack::hashFile)
+	uint64_t levelsHash;
+};
+
+/// Image of a spritex, made of 'pixelmap' and 'densitymap' files, or of 'pixelmap' only if 'densitymap' is empty
+struct PackImage
+{
+	char pixelmap[LEVEL_PACK_NAME_SIZE];
+	char densitymap[LEVEL_PACK_NAME_SIZE];
+	uint32_t width;
+	uint32_t height;
+	/// Number of SPRITEX_TILE_SIZE tiles in a row and in a column
+	uint32_t tileColumns;
+	uint32_t tileRows;
+	/// width * height * 4 bytes
+	uint64_t rgbaOffset;
+	/// tileColumns * tileRows SpritexTile entries, row by row
+	uint64_t tilesOffset;
+};
+
+struct PackLevel
+{
+	char code[LEVEL_PACK_CODE_SIZE];
+	/// Index of level image in PackImage table
+	uint32_t imageIndex;
+	/// Gems of level are PackGem table entries firstGem..firstGem+gemCount-1
+	uint32_t firstGem;
+	uint32_t gemCount;
+	uint32_t reserved;
+};
+
+struct PackGem
+{
+	int32_t x;
+	int32_t y;
+	/// Gem image number, as "idx" in levels.json
+	uint32_t idx;
+	uint32_t reserved;
+};
+
+class LevelPack
+{
+public:
+	LevelPack();
+	~LevelPack();
+	/// Map pack file into memory. Return false, if it can't be opened or it is not a valid pack of LEVEL_PACK_VERSION.
+	/// If 'levelsFile' is given and can be read, pack must be made of it: pack of another version of the file is stale and is not opened
+	bool open(const std::string& filename, const std::string& levelsFile = "");
+	void close();
+	bool isOpen() const { return _data != NULL; };
+	uint32_t getLevelCount() const { return _header()->levelCount; };
+	/// Return level number 'levelNum' (1-based) or NULL
+	const PackLevel* getLevel(int levelNum) const;
+	/// Return gem 'i' of 'level'
+	const PackGem* getGem(const PackLevel* level, uint32_t i) const { return reinterpret_cast<const PackGem*>(_data + _header()->gemsOffset) + level->firstGem + i; };
+	const PackImage* getImage(uint32_t index) const { return reinterpret_cast<const PackImage*>(_data + _header()->imagesOffset) + index; };
+	/// Return image of spritex made of 'pixelmap' and 'densitymap' (empty for spritex made of single image), or NULL if it is not in the pack
+	const PackImage* findImage(const std::string& pixelmap, const std::string& densitymap) const;
+	/// Pixel data of 'image'
+	const uint8_t* getRGBA(const PackImage* image) const { return _data + image->rgbaOffset; };
+	const SpritexTile* getTiles(const PackImage* image) const { return reinterpret_cast<const SpritexTile*>(_data + image->tilesOffset); };
+	/// Return true and FNV-1a hash of contents of file 'filename' in 'hash', or false if it can't be read
+	static bool hashFile(const std::string& filename, uint64_t& hash);
+private:
+	const PackHeader* _header() const { return reinterpret_cast<const PackHeader*>(_data); };
+	/// Return true if table of 'count' entries of 'size' bytes at 'offset' lies inside pack. Nothing is multiplied or added, so corrupted values can't overflow
+	bool _inside(uint64_t offset, uint64_t count, uint64_t size) const { return (offset <= _size) && ((count == 0) || (size <= (_size - offset) / count)); };
+	/// Mapped pack or NULL
+	const uint8_t* _data;
+	size_t _size;
+#ifdef _WIN32
+	void* _file;
+	void* _mapping;
+#endif
+};
+
+}; // namespace Diamondek
+
+#endif // _LEVELPACK_H_
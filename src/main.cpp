@@ -2,17 +2,123 @@
     \brief Main function
 
     Game entry point.
+    Run with "--headless [--level N] [--ticks M] [--seed S] [--input script.txt] [--record out.txt]" to simulate game without a window and report ticks/sec and final state hash.
+    Run with "--headless --replay recording.txt" to replay recorded game and check its state hash on every tick.
+    Run with "--record out.txt" to record played games (the last one is kept).
 */
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "splash.h"
 #include "menu.h"
 #include "help.h"
 #include "board.h"
+#include "input.h"
 
+#define HEADLESS_TICKS_DEFAULT 10000
+
+#ifdef _WIN32
 static HICON hIcon = NULL;
+#endif
 
-INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT) {
+/// Run simulation without window, return process exit code
+static int runHeadless(int argc, char* argv[])
+{
+	uint32_t level = 1;
+	uint32_t ticks = HEADLESS_TICKS_DEFAULT;
+	uint32_t seed = RNG_SEED_DEFAULT;
+	uint32_t ticksDone, failedTick;
+	Diamondek::InputScript script, recording;
+	const char* recordFile = NULL;
+	const char* replayFile = NULL;
+	sf::Clock clock;
+	float seconds;
+	bool replayed;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0) continue;
+		if ((strcmp(argv[i], "--level") == 0) && (i + 1 < argc)) { level = atoi(argv[++i]); continue; };
+		if ((strcmp(argv[i], "--ticks") == 0) && (i + 1 < argc)) { ticks = atoi(argv[++i]); continue; };
+		if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) { seed = strtoul(argv[++i], NULL, 10); continue; };
+		if ((strcmp(argv[i], "--record") == 0) && (i + 1 < argc)) { recordFile = argv[++i]; continue; };
+		if ((strcmp(argv[i], "--replay") == 0) && (i + 1 < argc))
+		{
+			replayFile = argv[++i];
+			if (!recording.loadFromFile(replayFile))
+			{
+				fprintf(stderr, "Error loading recording %s\n", replayFile);
+				return EXIT_FAILURE;
+			};
+			continue;
+		};
+		if ((strcmp(argv[i], "--input") == 0) && (i + 1 < argc))
+		{
+			if (!script.loadFromFile(argv[++i]))
+			{
+				fprintf(stderr, "Error loading input script %s\n", argv[i]);
+				return EXIT_FAILURE;
+			};
+			continue;
+		};
+		fprintf(stderr, "Usage: %s --headless [--level N] [--ticks M] [--seed S] [--input script.txt] [--record out.txt]\n"
+			"       %s --headless --replay recording.txt\n", argv[0], argv[0]);
+		return EXIT_FAILURE;
+	};
+	try
+	{
+		Diamondek::Board board("data/board_bkg.png", true);
+		if (replayFile)
+		{
+			clock.restart();
+			replayed = board.replay(recording, failedTick);
+			seconds = clock.getElapsedTime().asSeconds();
+			ticksDone = replayed ? recording.getLength() : failedTick;
+			level = recording.getLevel();
+		}
+		else
+		{
+			board.setSeed(seed);
+			if (recordFile) board.setRecording(&recording);
+			clock.restart();
+			ticksDone = board.runHeadless(level, ticks, script);
+			seconds = clock.getElapsedTime().asSeconds();
+			if (recordFile && !recording.saveToFile(recordFile))
+			{
+				fprintf(stderr, "Error saving recording %s\n", recordFile);
+				return EXIT_FAILURE;
+			};
+		};
+		printf("level: %u\n", level);
+		printf("ticks: %u\n", ticksDone);
+		printf("seconds: %.3f\n", seconds);
+		printf("ticks/sec: %.1f\n", seconds > 0 ? ticksDone / seconds : 0.0f);
+		printf("state hash: %016llx\n", static_cast<unsigned long long>(board.getStateHash()));
+		if (replayFile && !replayed)
+		{
+			printf("replay diverged at tick %u\n", failedTick);
+			return EXIT_FAILURE;
+		};
+		if (replayFile) printf("replay ok\n");
+	}
+	catch(const char* s)
+	{
+		fprintf(stderr, "%s\n", s);
+		return EXIT_FAILURE;
+	}
+	catch(const std::string& s)
+	{
+		fprintf(stderr, "%s\n", s.c_str());
+		return EXIT_FAILURE;
+	};
+	return EXIT_SUCCESS;
+};
+
+int main(int argc, char* argv[]) {
 
 	Diamondek::Splash* pSplash;
 	Diamondek::Menu* pMenu;
@@ -20,6 +126,14 @@ INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT) {
 	Diamondek::Board* pBoard;
 
 	sf::Color textColor;
+	Diamondek::InputScript recording;
+	const char* recordFile = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0) return runHeadless(argc, argv);
+		if ((strcmp(argv[i], "--record") == 0) && (i + 1 < argc)) recordFile = argv[++i];
+	};
 
 	// Create the window of the application
 	sf::RenderWindow gameWindow(sf::VideoMode(RESOLUTION_X, RESOLUTION_Y, 32), "Diamondek", sf::Style::Titlebar);
@@ -33,13 +147,13 @@ INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT) {
 	{
 		pSplash->loadResources();
 	}
-	catch(char* s)
+	catch(const char* s)
 	{
-		s; // Do something...
+		(void)s; // Do something...
 	};
 	pSplash->run();
 	delete pSplash;
-	
+
 	// Prepare menu and run application loop
 	pMenu = new Diamondek::Menu(gameWindow);
 	pMenu->loadResources();
@@ -50,8 +164,10 @@ INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT) {
 			// Run game from first level
 			case Diamondek::maNewGame:
 				pBoard = new Diamondek::Board("data/board_bkg.png");
+				if (recordFile) pBoard->setRecording(&recording);
 				pBoard->run(gameWindow);
 				delete pBoard;
+				if (recordFile) recording.saveToFile(recordFile);
 				break;
 			// Enter code and run game from appropriate level
 			case Diamondek::maEnterCode:
@@ -66,10 +182,19 @@ INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT) {
 			// Exit game application
 			case Diamondek::maExit:
 				gameWindow.close();
+#ifdef _WIN32
 				DestroyIcon(hIcon);
+#endif
 				return EXIT_SUCCESS;
 				break;
 		};
 	};
     return EXIT_SUCCESS;
 }
+
+#ifdef _WIN32
+// Windows GUI subsystem entry point
+INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR strCmdLine, INT) {
+	return main(__argc, __argv);
+}
+#endif
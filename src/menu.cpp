@@ -9,7 +9,7 @@
 
 namespace Diamondek {
 
-Menu::Menu(sf::RenderWindow &gameWindow)
+Menu::Menu(sf::RenderWindow &gameWindow) : _scheduler(gameWindow, "menu")
 {
 	_gameWindow = &gameWindow;
 	_activeItem = 0;
@@ -29,7 +29,7 @@ Menu::~Menu()
 menuActions Menu::processEvents()
 {
     sf::Event Event;
-    while (_gameWindow->waitEvent(Event))
+    while (_scheduler.waitEvent(Event))
     {
 		switch(Event.type)
 		{
@@ -48,11 +48,13 @@ menuActions Menu::processEvents()
 						_activeItem++;
 						if (_activeItem == _items.size()) _activeItem = 0;
 						_menuMoveSound.play();
+						_scheduler.invalidate();
 						return maNone;
 						break;
 					case sf::Keyboard::Up:
 						if (_activeItem == 0) _activeItem = _items.size() - 1; else _activeItem--;
 						_menuMoveSound.play();
+						_scheduler.invalidate();
 						//while (sound.getStatus() != sf::Sound::Stopped);
 						return maNone;
 						break;
@@ -93,7 +95,8 @@ void Menu::addItem(std::string text)
 menuActions Menu::run()
 {
 	_music.play(); _music.setVolume(20);
-	draw();
+	// Window was drawn by another screen
+	_scheduler.invalidate();
 	_isRunning = true;
 	while (_isRunning)
 	{
@@ -120,7 +123,9 @@ menuActions Menu::run()
 				return maExit;
 			};
 		};
+		if (!_scheduler.frameDue()) continue;
 		draw();
+		_scheduler.frameDone();
 	};
 	return maNone;
 };
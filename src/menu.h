@@ -10,6 +10,7 @@
 
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include "framescheduler.h"
 
 #define MENU_FONT_SIZE 60
 #define MENU_POSITION_X 100
@@ -29,7 +30,7 @@ class Menu
 public:
     Menu(sf::RenderWindow &gameWindow);
 	~Menu();
-	/// Process system events
+	/// Process system events, wait for them while there is nothing to draw
 	menuActions processEvents();
 	void loadResources();
 	void addItem(std::string text);
@@ -48,6 +49,8 @@ private:
 	sf::Sound _menuMoveSound;
 	sf::Sound _menuSelectSound;
 	sf::RenderWindow* _gameWindow;
+	/// Menu is redrawn only when active item changes
+	FrameScheduler _scheduler;
 };
 
 }; // namespace Diamondek
@@ -0,0 +1,139 @@
+/*!
+	\class Diamondek::RenderBatch
+    \brief RenderBatch class
+*/
+
+#include <algorithm>
+#include "renderbatch.h"
+
+namespace Diamondek {
+
+/// Return true if 'a' is higher than 'b', for packing atlas shelves
+static bool _higher(const SpritexAssetPtr& a, const SpritexAssetPtr& b)
+{
+	return a->size.y > b->size.y;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+RenderBatch::RenderBatch()
+{
+	_hasAtlas = false;
+	_dynamicTop = 0;
+	_dynamicX = 0;
+	_dynamicY = 0;
+	_dynamicShelf = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void RenderBatch::setAssets(const std::vector<SpritexAssetPtr>& assets)
+{
+	std::vector<SpritexAssetPtr> sorted(assets);
+	unsigned int width = std::min(static_cast<unsigned int>(RENDER_ATLAS_WIDTH), sf::Texture::getMaximumSize());
+	unsigned int x = 0, y = 0, shelf = 0;
+
+	// Assets made during the previous level are not needed anymore
+	for (std::vector<SpritexAssetPtr>::iterator i = _dynamicAssets.begin(); i != _dynamicAssets.end(); ++i) _rects.erase(i->get());
+	_dynamicAssets.clear();
+	_dynamicX = _dynamicY = _dynamicShelf = 0;
+	// Unique assets, higher first: shelves are filled left to right, each one is as high as its first image
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+	std::stable_sort(sorted.begin(), sorted.end(), _higher);
+	if (_hasAtlas && (sorted == _assets)) return;
+	_assets.clear();
+	_rects.clear();
+	_hasAtlas = false;
+	for (std::vector<SpritexAssetPtr>::iterator i = sorted.begin(); i != sorted.end(); ++i)
+	{
+		const sf::Vector2u& size = (*i)->size;
+		if (size.x > width) continue; // too large, drawn separately
+		if (x + size.x > width)
+		{
+			x = 0;
+			y += shelf + RENDER_ATLAS_PADDING;
+			shelf = 0;
+		};
+		if (y + size.y + RENDER_ATLAS_PADDING + RENDER_ATLAS_DYNAMIC_HEIGHT > sf::Texture::getMaximumSize()) break; // atlas is full, the rest is drawn separately
+		if (shelf == 0) shelf = size.y;
+		_rects[i->get()] = sf::IntRect(x, y, size.x, size.y);
+		_assets.push_back(*i);
+		x += size.x + RENDER_ATLAS_PADDING;
+	};
+	_dynamicTop = _assets.empty() ? 0 : y + shelf + RENDER_ATLAS_PADDING;
+	if (!_atlas.create(width, _dynamicTop + RENDER_ATLAS_DYNAMIC_HEIGHT))
+	{ // no atlas, everything is drawn separately
+		_assets.clear();
+		_rects.clear();
+		return;
+	};
+	_hasAtlas = true;
+	for (std::vector<SpritexAssetPtr>::iterator i = _assets.begin(); i != _assets.end(); ++i)
+	{
+		const sf::IntRect& r = _rects[i->get()];
+		_atlas.update((*i)->texture, r.left, r.top);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool RenderBatch::addDynamicAsset(const SpritexAssetPtr& asset)
+{
+	const sf::Vector2u& size = asset->size;
+	unsigned int width = _atlas.getSize().x;
+
+	if (!_hasAtlas || (size.x > width)) return false;
+	// Shelves are filled left to right, as in 'setAssets', but images come in any order, so shelf is as high as its highest image
+	if (_dynamicX + size.x > width)
+	{
+		_dynamicX = 0;
+		_dynamicY += _dynamicShelf + RENDER_ATLAS_PADDING;
+		_dynamicShelf = 0;
+	};
+	if (_dynamicY + size.y > RENDER_ATLAS_DYNAMIC_HEIGHT) return false; // full until its assets are released
+	_rects[asset.get()] = sf::IntRect(_dynamicX, _dynamicTop + _dynamicY, size.x, size.y);
+	_dynamicAssets.push_back(asset);
+	_atlas.update(asset->texture, _dynamicX, _dynamicTop + _dynamicY);
+	_dynamicX += size.x + RENDER_ATLAS_PADDING;
+	_dynamicShelf = std::max(_dynamicShelf, size.y);
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void RenderBatch::releaseDynamicAssets()
+{
+	if (_dynamicAssets.empty()) return;
+	// Region is packed linearly, so it can be reused only as a whole
+	for (std::vector<SpritexAssetPtr>::iterator i = _dynamicAssets.begin(); i != _dynamicAssets.end(); ++i)
+		if (i->use_count() > 1) return;
+	for (std::vector<SpritexAssetPtr>::iterator i = _dynamicAssets.begin(); i != _dynamicAssets.end(); ++i) _rects.erase(i->get());
+	_dynamicAssets.clear();
+	_dynamicX = _dynamicY = _dynamicShelf = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void RenderBatch::add(const Spritex& spritex, const sf::Transform& transform)
+{
+	const sf::IntRect& r = _rects.find(spritex.getAsset().get())->second;
+	sf::Transform t = transform * spritex.getTransform();
+	float w = static_cast<float>(r.width);
+	float h = static_cast<float>(r.height);
+	float u = static_cast<float>(r.left);
+	float v = static_cast<float>(r.top);
+
+	_vertices.setPrimitiveType(sf::Quads);
+	_vertices.append(sf::Vertex(t.transformPoint(0, 0), sf::Vector2f(u, v)));
+	_vertices.append(sf::Vertex(t.transformPoint(w, 0), sf::Vector2f(u + w, v)));
+	_vertices.append(sf::Vertex(t.transformPoint(w, h), sf::Vector2f(u + w, v + h)));
+	_vertices.append(sf::Vertex(t.transformPoint(0, h), sf::Vector2f(u, v + h)));
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void RenderBatch::draw(sf::RenderTarget& target)
+{
+	sf::RenderStates states;
+	if (_vertices.getVertexCount() == 0) return;
+	states.texture = &_atlas;
+	target.draw(_vertices, states);
+	_vertices.clear();
+};
+
+}; // namespace Diamondek
\ No newline at end of file
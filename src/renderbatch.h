@@ -0,0 +1,61 @@
+/*!
+	\class Diamondek::RenderBatch
+    \brief RenderBatch class
+
+    Draws many spritexes with one draw call. Textures of their assets are packed into a runtime atlas, and every frame spritexes are added
+    as quads of one vertex array. Spritexes with their own (damaged) texture or assets missing from the atlas are drawn separately by caller.
+    Assets made during the level (debris) are packed into a dynamic region at the bottom of the atlas, which is reused when they are gone.
+*/
+
+#ifndef _RENDERBATCH_H_
+#define _RENDERBATCH_H_
+
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <vector>
+#include "spritex.h"
+
+// Atlas width in pixels (or less, if textures can't be that large). Height is as much as needed
+#define RENDER_ATLAS_WIDTH 2048
+// Gap between atlas images, so neighbours never bleed into each other
+#define RENDER_ATLAS_PADDING 1
+// Height of atlas region for assets made during the level
+#define RENDER_ATLAS_DYNAMIC_HEIGHT 256
+
+namespace Diamondek {
+
+class RenderBatch
+{
+public:
+	RenderBatch();
+	/// Pack textures of 'assets' into atlas. Nothing is done if they are the same as the last time. Dynamic region is emptied
+	void setAssets(const std::vector<SpritexAssetPtr>& assets);
+	/// Pack texture of 'asset' made during the level (e.g. debris) into dynamic region of atlas. Return false if it doesn't fit, then it is drawn separately
+	bool addDynamicAsset(const SpritexAssetPtr& asset);
+	/// Empty dynamic region, if none of its assets is used by anybody else anymore
+	void releaseDynamicAssets();
+	/// Return true if 'spritex' can be added to batch: it draws asset texture, which is in atlas
+	bool accepts(const Spritex& spritex) const { return spritex.isTexturePristine() && (_rects.find(spritex.getAsset().get()) != _rects.end()); };
+	/// Add 'spritex' transformed by 'transform' (in addition to its own transform) to batch. It must be accepted
+	void add(const Spritex& spritex, const sf::Transform& transform);
+	/// Draw all added spritexes with one draw call and clear batch. Called before drawing anything separately, so draw order is kept
+	void draw(sf::RenderTarget& target);
+private:
+	sf::Texture _atlas;
+	/// True if '_atlas' is created
+	bool _hasAtlas;
+	/// Atlas regions of assets
+	std::map<const SpritexAsset*, sf::IntRect> _rects;
+	/// Assets in atlas, they are held so that '_rects' keys stay valid
+	std::vector<SpritexAssetPtr> _assets;
+	/// Assets in dynamic region, which starts at '_dynamicTop' row of atlas. Next one is packed to '_dynamicX', '_dynamicY' (relative to region),
+	/// current shelf of region is '_dynamicShelf' high
+	std::vector<SpritexAssetPtr> _dynamicAssets;
+	unsigned int _dynamicTop, _dynamicX, _dynamicY, _dynamicShelf;
+	/// Quads of added spritexes
+	sf::VertexArray _vertices;
+};
+
+}; // namespace Diamondek
+
+#endif // _RENDERBATCH_H_
@@ -5,11 +5,13 @@
     Splash screen is displayed once during game startup.
 */
 
+#include <algorithm>
+#include <chrono>
 #include "splash.h"
 
 namespace Diamondek {
 
-Splash::Splash(sf::RenderWindow &gameWindow)
+Splash::Splash(sf::RenderWindow &gameWindow) : _scheduler(gameWindow, "splash")
 {
 	_gameWindow = &gameWindow;
 };
@@ -20,18 +22,52 @@ Splash::~Splash()
 
 void Splash::loadResources()
 {
-	if (_splash1.loadFromFile(SPLASH1) == false) throw "Error loading image " SPLASH1;
-	if (_splash2.loadFromFile(SPLASH2) == false) throw "Error loading image " SPLASH2;
-	if (_splash3.loadFromFile(SPLASH3) == false) throw "Error loading image " SPLASH3;
+	const char* files[SPLASH_COUNT] = { SPLASH1, SPLASH2, SPLASH3 };
 
-	_buffer.create(RESOLUTION_X, RESOLUTION_Y);
-	_sprite.setTexture(_buffer);
+	for (int i = 0; i < SPLASH_COUNT; i++)
+	{
+		try
+		{
+			_images[i] = std::async(std::launch::async, &Splash::_loadImage, std::string(files[i]));
+		}
+		catch(...)
+		{ // No threads, image is decoded when it is needed
+			_images[i] = std::async(std::launch::deferred, &Splash::_loadImage, std::string(files[i]));
+		};
+	};
+};
+
+sf::Image Splash::_loadImage(const std::string& filename)
+{
+	sf::Image image;
+	if (image.loadFromFile(filename) == false) throw "Error loading image " + filename;
+	return image;
+};
+
+bool Splash::_prepareTexture(int index)
+{
+	if (!_images[index].valid()) return false;
+	while (_images[index].wait_for(std::chrono::milliseconds(SPLASH_WAIT_MSEC)) == std::future_status::timeout)
+	{
+		processEvents();
+		if (!_isRunning) return false;
+	};
+	try
+	{
+		if (!_textures[index].loadFromImage(_images[index].get())) return false;
+	}
+	catch(...)
+	{ // Image is missing, it is not shown
+		return false;
+	};
+	_sprite.setTexture(_textures[index], true);
+	return true;
 };
 
 void Splash::processEvents()
 {
     sf::Event Event;
-    while (_gameWindow->pollEvent(Event))
+    while (_scheduler.waitEvent(Event))
     {
 		switch(Event.type)
 		{
@@ -52,58 +88,55 @@ void Splash::processEvents()
 void Splash::run()
 {
 	_isRunning = true;
-	showImageByFadeTransition(_splash1, 1, 3, 1);
-	if (_isRunning) showImageByFadeTransition(_splash2, 1, 3, 1);
-	if (_isRunning) showImageByFadeTransition(_splash3, 1, 1, 0);
+	_scheduler.setAnimating(true);
+	// Black screen at once, while the first image is decoded
+	_gameWindow->clear();
+	_gameWindow->display();
+	showImageByFadeTransition(0, 1, 3, 1);
+	if (_isRunning) showImageByFadeTransition(1, 1, 3, 1);
+	if (_isRunning) showImageByFadeTransition(2, 1, 1, 0);
 };
 
-void Splash::showImageByFadeTransition(sf::Image& img, float fadeOutTime, float showTime, float fadeInTime)
+void Splash::showImageByFadeTransition(int index, float fadeOutTime, float showTime, float fadeInTime)
 {
 	sf::Clock clk;
 	float time;
 
+	if (!_prepareTexture(index)) return;
 	clk.restart();
 	while ((clk.getElapsedTime().asSeconds() < (fadeOutTime + showTime + fadeInTime)) && _isRunning)
 	{
+		// Events are processed until it is time for the next frame
 		processEvents();
+		if (!_isRunning || !_scheduler.frameDue()) continue;
 		_gameWindow->clear();
 		time = clk.getElapsedTime().asSeconds();
 		// Fade out
 		if ((fadeOutTime!=0) && (time < fadeOutTime))
 		{
-			fadeImage(_buffer, img, 1 - (fadeOutTime - time) / fadeOutTime);
+			fadeSprite(1 - (fadeOutTime - time) / fadeOutTime);
 		};
 		// Show still image
 		if ((showTime!=0) && (time >= fadeOutTime) && (time < (fadeOutTime + showTime)))
 		{
-			fadeImage(_buffer, img, showTime);
+			fadeSprite(1);
 		};
 		// Fade in black
 		if ((fadeInTime!=0) && (time >= (fadeOutTime + showTime)) && (time < (fadeOutTime + showTime + fadeInTime)))
 		{
-			fadeImage(_buffer, img, (fadeInTime + fadeOutTime + showTime - time) / fadeInTime);
+			fadeSprite((fadeInTime + fadeOutTime + showTime - time) / fadeInTime);
 		};
 		_gameWindow->draw(_sprite);
 		_gameWindow->display();
+		_scheduler.frameDone();
 	}; //while
 };
 
-void Splash::fadeImage(sf::Texture& dst, const sf::Image& src, float amount)
+void Splash::fadeSprite(float amount)
 {
-	uint32_t sx = dst.getSize().x;
-	uint32_t sy = dst.getSize().y;
-	sf::Color c;
-	sf::Image tmpImg;
-
-	tmpImg.create(sx, sy);
-	for (uint32_t y = 0; y < sy; y++)
-		for (uint32_t x = 0; x < sx; x++)
-		{
-			c = src.getPixel(x, y);
-			c.a = (sf::Uint8)(255 * amount);
-			tmpImg.setPixel(x, y, c);
-		};
-	dst.update(tmpImg);
+	// Window is cleared to black, so transparency of the sprite fades it from black
+	amount = std::min(std::max(amount, 0.0f), 1.0f);
+	_sprite.setColor(sf::Color(255, 255, 255, static_cast<sf::Uint8>(255 * amount)));
 };
 
 }; // namespace Diamondek
\ No newline at end of file
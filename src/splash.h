@@ -9,6 +9,7 @@
 	4. FadeIn to black
 	5. FadeOut from black to Main menu background
 	6. Exit
+	Images are decoded in background, each one is uploaded to its texture once. Fading is done by sprite color, no pixels are touched per frame.
 */
 
 #ifndef _SPLASH_H_
@@ -17,10 +18,16 @@
 #define SPLASH1 "data/splash1.png"
 #define SPLASH2 "data/splash2.png"
 #define SPLASH3 "data/menu_background.png"
+#define SPLASH_COUNT 3
+// Events are processed this often while image is not decoded yet
+#define SPLASH_WAIT_MSEC 10
 
 #include "globals.h"
 #include <SFML/Graphics.hpp>
 #include <boost/lexical_cast.hpp>
+#include <future>
+#include <string>
+#include "framescheduler.h"
 
 namespace Diamondek {
 
@@ -29,21 +36,29 @@ class Splash
 public:
     Splash(sf::RenderWindow &gameWindow);
 	~Splash();
+	/// Start decoding splash images in background. Errors are reported by 'run', which skips images failed to load
 	void loadResources();
 	void run();
-	/// Process system events
+	/// Process system events until the next frame is due
 	void processEvents();
-	/// Make image in dst with src, faded from black in amount (0 - pure black, 1 - dst=src)
-	void fadeImage(sf::Texture& dst, const sf::Image& src, float amount);
-	/// Fade-out image from the black, wait and fade-in back to the black. Zero time in any parameter mean no transition
-	void showImageByFadeTransition(sf::Image& img, float fadeOutTime, float showTime, float fadeInTime);
+	/// Fade sprite from black in amount (0 - pure black, 1 - image as is)
+	void fadeSprite(float amount);
+	/// Fade-out image number 'index' from the black, wait and fade-in back to the black. Zero time in any parameter mean no transition
+	void showImageByFadeTransition(int index, float fadeOutTime, float showTime, float fadeInTime);
 private:
+	/// Decode image file 'filename', throw if it can't be loaded. Runs in background
+	static sf::Image _loadImage(const std::string& filename);
+	/// Wait for image 'index' to be decoded, processing events meanwhile, and upload it to '_textures'. Return false if it can't be loaded or splash was interrupted
+	bool _prepareTexture(int index);
 	bool _isRunning;
-	sf::Texture _buffer;
-	sf::Image _splash1, _splash2, _splash3;
+	/// Images being decoded
+	std::future<sf::Image> _images[SPLASH_COUNT];
+	sf::Texture _textures[SPLASH_COUNT];
 	sf::Sprite _sprite;
 	sf::RenderWindow* _gameWindow;
 	sf::Clock _clock;
+	/// Splash is animated all the time, scheduler limits its frame rate
+	FrameScheduler _scheduler;
 };
 
 }; // namespace Diamondek
@@ -3,44 +3,65 @@
     \brief Spritex class
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SPRITEX_SSE2
+#include <emmintrin.h>
+#endif
 #include "spritex.h"
+#include "hash.h"
 
 namespace Diamondek {
 
+bool Spritex::_headless = false;
+
+/// Return index of the lowest set bit of non-zero 'v'
+static inline int _lowestSetBit(uint64_t v)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, v);
+	return static_cast<int>(idx);
+#else
+	return __builtin_ctzll(v);
+#endif
+};
+
+/// Return number of set bits in 'v'
+static inline int _bitCount(uint32_t v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return static_cast<int>((((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 Spritex::Spritex(const std::string& filename, unsigned int maxDensity)
 {
-	int sx, sy;
-	sf::Color c;
-	float density;
-
-	if (_densityMap.loadFromFile(filename) == false) throw "Error loading image " + filename;
-	_texture.loadFromImage(_densityMap);
-	_sprite.setTexture(_texture);
-	sx = _densityMap.getSize().x;
-	sy = _densityMap.getSize().y;
-	for (int y = 0; y < sy; y++)
-		for (int x = 0; x < sx; x++)
-		{
-			c = _densityMap.getPixel(x, y);
-			// calculate density value as a mean of (R,G,B) values
-			//density = 255 - (static_cast<float>(c.r + c.g + c.b) / 3);
-			// normalize density to maxDensity
-			//density = (density * maxDensity) / 255;
-			density = MAX_DENSITY_DEFAULT;
-			// update density map
-			_densityMap.setPixel(x, y, sf::Color(static_cast<unsigned int>(density), static_cast<unsigned int>(density), static_cast<unsigned int>(density), c.a));
-		};
+	std::shared_ptr<SpritexAsset> asset = SpritexAsset::loadFromFiles(filename, "", maxDensity);
+	asset->createTexture();
+	_asset = asset;
 	_initDefaults();
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 Spritex::Spritex(const std::string& pixelmap, const std::string& densitymap)
 {
-	if (_texture.loadFromFile(pixelmap) == false) throw "Error loading image" + pixelmap;
-	if (_densityMap.loadFromFile(densitymap) == false) throw "Error loading image" + densitymap;
-	if ((_texture.getSize() != _densityMap.getSize())) throw "Wrong combination of pixel and density maps";
-	_sprite.setTexture(_texture);
+	std::shared_ptr<SpritexAsset> asset = SpritexAsset::loadFromFiles(pixelmap, densitymap, 0);
+	asset->createTexture();
+	_asset = asset;
+	_initDefaults();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Spritex::Spritex(const SpritexAssetPtr& asset)
+{
+	_asset = asset;
 	_initDefaults();
 };
 
@@ -52,27 +73,49 @@ Spritex::~Spritex(void)
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Spritex::_initDefaults()
 {
-	_prepareDbgAlphaTexture();
-	_destructible = false;
-	_dynamic = false;
-	_dead = false;
-	_speed = sf::Vector2f(0, 0);
-	_accel = sf::Vector2f(0, 0);
+	_size = _asset->size;
+	_tileColumns = _asset->tileColumns;
+	_tileRows = _asset->tileRows;
+	_tileData.resize(_asset->tiles.size());
+	for (size_t k = 0; k < _asset->tiles.size(); k++) _tileData[k] = &_asset->tiles[k];
+	_ownTile.assign(_asset->tiles.size(), NULL);
+	_pageColumns = 0;
+	_quadsDirty = false;
+	_sourcePixels = NULL;
+	_dbgTexturesReady = false;
+	_dbgDirty = false;
+	_maskDamaged = false;
+	if (_headless) return;
+	_sprite.setTexture(_asset->texture);
+	// Image is too large for one texture, it is drawn by pages from the beginning
+	if ((_asset->texture.getSize().x == 0) && !_asset->tiles.empty()) _preparePages();
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Spritex::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
-	states.transform = getTransform();
-	target.draw(_sprite, states);
+	if (_headless) return;
+	states.transform *= getTransform();
+	if (_pages.empty())
+	{
+		target.draw(_sprite, states);
+		return;
+	};
+	for (size_t p = 0; p < _pages.size(); p++)
+	{
+		if (_pageQuads[p].getVertexCount() == 0) continue;
+		states.texture = &_pages[p];
+		target.draw(_pageQuads[p], states);
+	};
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 bool Spritex::_AABBIntersection(const Spritex& second)
 {
-	sf::FloatRect thisBB = _sprite.getLocalBounds();
+	// Local bounds come from density map, sprite has no texture in headless mode
+	sf::FloatRect thisBB = getAABB();
 	sf::Transform thisTransform = getTransform();
-	sf::FloatRect thatBB = second._sprite.getLocalBounds();
+	sf::FloatRect thatBB = second.getAABB();
 	sf::Transform thatTransform = second.getTransform();
 	// Apply current transform to sprite BB and get AABBs
 	thisBB = thisTransform.transformRect(thisBB);
@@ -109,16 +152,238 @@ bool Spritex::_AABBIntersection(const Spritex& second)
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Spritex::applyImpulseOfForce(sf::Vector2f force)
+void Spritex::setPixel(int x, int y, sf::Color c)
+{
+	if (!_preparePages()) return;
+	OwnTile& tile = _writableTile(x / SPRITEX_TILE_SIZE, y / SPRITEX_TILE_SIZE);
+	sf::Uint8* pixel = &tile.pixels[((y % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE + x % SPRITEX_TILE_SIZE) * 4];
+	pixel[0] = c.r;
+	pixel[1] = c.g;
+	pixel[2] = c.b;
+	pixel[3] = c.a;
+	_markTileDirty(tile);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::setDensityAt(int x, int y, int density, int alpha)
 {
-	_speed += force;
+	OwnTile& tile = _writableTile(x / SPRITEX_TILE_SIZE, y / SPRITEX_TILE_SIZE);
+	tile.maps.density[(y % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE + x % SPRITEX_TILE_SIZE] = density;
+	_setMaskAt(x, y, alpha != 0);
+	_markMaskDamage(sf::IntRect(x, y, 1, 1));
+	if (_dbgTexturesReady) _markDbgDirty(x, y);
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::destroyPixel(int x, int y)
+{
+	// The same as 'setPixel' and 'setDensityAt', but the tile is looked up once
+	OwnTile& tile = _writableTile(x / SPRITEX_TILE_SIZE, y / SPRITEX_TILE_SIZE);
+	int k = (y % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE + x % SPRITEX_TILE_SIZE;
+	tile.maps.density[k] = 0;
+	tile.maps.mask[y % SPRITEX_TILE_SIZE] &= ~(static_cast<uint64_t>(1) << (x % SPRITEX_TILE_SIZE));
+	tile.maps.state = TILE_MIXED;
+	_markMaskDamage(sf::IntRect(x, y, 1, 1));
+	if (_dbgTexturesReady) _markDbgDirty(x, y);
+	if (tile.pixels.empty()) return;
+	memset(&tile.pixels[k * 4], 0, 4);
+	_markTileDirty(tile);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::flushDamage()
+{
+	OwnTile* tile;
+	for (std::vector<OwnTile*>::iterator i = _dirtyTiles.begin(); i != _dirtyTiles.end(); ++i)
+	{
+		// Tile pixels are contiguous, edge tiles are uploaded whole too, their pixels out of the image are transparent
+		tile = *i;
+		_pages[(tile->ty / SPRITEX_PAGE_TILES) * _pageColumns + tile->tx / SPRITEX_PAGE_TILES].update(tile->pixels.data(), SPRITEX_TILE_SIZE, SPRITEX_TILE_SIZE,
+			(tile->tx % SPRITEX_PAGE_TILES) * SPRITEX_TILE_SIZE, (tile->ty % SPRITEX_PAGE_TILES) * SPRITEX_TILE_SIZE);
+		tile->dirty = false;
+	};
+	_dirtyTiles.clear();
+	if (_quadsDirty) _buildQuads();
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int Spritex::explode(const sf::Vector2f& center, float radius)
+{
+	int sx = _size.x;
+	int sy = _size.y;
+	float r2 = radius * radius;
+	int miny = std::max(0, static_cast<int>(ceil(center.y - radius)));
+	int maxy = std::min(sy - 1, static_cast<int>(floor(center.y + radius)));
+	int destroyed = 0;
+	int x0, x1, minx = sx, maxx = -1, base, y1;
+	int left = sx, right = -1, top = sy, bottom = -1; // bounds of destroyed spans
+	float dy, half;
+	OwnTile* tile;
+
+	_preparePages();
+	_spans.clear();
+	for (int y = miny; y <= maxy; y++)
+	{
+		dy = y - center.y;
+		// Row span of the circle. Ends are corrected for rounding, so that every pixel inside passes (x - center.x)^2 + dy^2 <= r2
+		half = (dy * dy > r2) ? -1 : sqrt(r2 - dy * dy);
+		x0 = static_cast<int>(ceil(center.x - half));
+		x1 = static_cast<int>(floor(center.x + half));
+		if ((x0 - center.x) * (x0 - center.x) + dy * dy > r2) x0++;
+		if ((x1 - center.x) * (x1 - center.x) + dy * dy > r2) x1--;
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, sx - 1);
+		_spans.push_back(sf::Vector3i(x0, x1, 0));
+		if (x0 > x1) continue;
+		minx = std::min(minx, x0);
+		maxx = std::max(maxx, x1);
+	};
+	// Tile by tile, so each tile is looked up (and copied) once. Tiles, which no span crosses, are left alone
+	for (int ty = miny / SPRITEX_TILE_SIZE; (minx <= maxx) && (ty <= maxy / SPRITEX_TILE_SIZE); ty++)
+	{
+		base = ty * SPRITEX_TILE_SIZE;
+		y1 = std::min(maxy, base + SPRITEX_TILE_SIZE - 1);
+		for (int tx = minx / SPRITEX_TILE_SIZE; tx <= maxx / SPRITEX_TILE_SIZE; tx++)
+		{
+			tile = NULL;
+			for (int y = std::max(miny, base); y <= y1; y++)
+			{
+				sf::Vector3i& span = _spans[y - miny];
+				x0 = std::max(span.x, tx * SPRITEX_TILE_SIZE);
+				x1 = std::min(span.y, tx * SPRITEX_TILE_SIZE + SPRITEX_TILE_SIZE - 1);
+				if (x0 > x1) continue;
+				if (tile == NULL) tile = &_writableTile(tx, ty);
+				span.z += _explodeSpan(*tile, y - base, x0 - tx * SPRITEX_TILE_SIZE, x1 - tx * SPRITEX_TILE_SIZE);
+			};
+		};
+	};
+	for (int y = miny; y <= maxy; y++)
+	{
+		const sf::Vector3i& span = _spans[y - miny];
+		if (span.z == 0) continue;
+		destroyed += span.z;
+		left = std::min(left, span.x);
+		right = std::max(right, span.y);
+		top = std::min(top, y);
+		bottom = y;
+	};
+	// Surviving pixels lost density too, debug views show it
+	if (_dbgTexturesReady && (miny <= maxy))
+	{
+		_markDbgDirty(std::max(0, static_cast<int>(floor(center.x - radius))), miny);
+		_markDbgDirty(std::min(sx - 1, static_cast<int>(ceil(center.x + radius))), maxy);
+	};
+	if (destroyed == 0) return destroyed;
+	_updateTiles(sf::IntRect(left, top, right - left + 1, bottom - top + 1));
+	_markMaskDamage(sf::IntRect(left, top, right - left + 1, bottom - top + 1));
+	return destroyed;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Spritex::physicsTick()
+bool Spritex::takeMaskDamage(sf::IntRect& rect)
 {
-	_speed += _accel;
-	setPosition(getPosition() + _speed);
+	if (!_maskDamaged) return false;
+	rect = _maskDamage;
+	_maskDamaged = false;
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+std::shared_ptr<SpritexAsset> Spritex::cut(const sf::IntRect& rect, const std::vector<uint64_t>& selection)
+{
+	bool rgba = _preparePages();
+	std::vector<uint8_t> density(rect.width * rect.height, 0);
+	std::vector<sf::Uint8> pixels(rgba ? rect.width * rect.height * 4 : 0, 0);
+
+	_takeSelection(rect, selection, density.data(), rgba ? pixels.data() : NULL);
+	return SpritexAsset::loadFromMaps(sf::Vector2u(rect.width, rect.height), density, selection, rgba ? pixels.data() : NULL);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::erase(const sf::IntRect& rect, const std::vector<uint64_t>& selection)
+{
+	_takeSelection(rect, selection, NULL, NULL);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::_takeSelection(const sf::IntRect& rect, const std::vector<uint64_t>& selection, uint8_t* density, sf::Uint8* pixels)
+{
+	int stride = (rect.width + MASK_WORD_BITS - 1) / MASK_WORD_BITS;
+	uint64_t bits;
+	int x, gx, gy, k;
+
+	for (int y = 0; y < rect.height; y++)
+	{
+		gy = rect.top + y;
+		for (int w = 0; w < stride; w++)
+			for (bits = selection[y * stride + w]; bits != 0; bits &= bits - 1)
+			{
+				x = w * MASK_WORD_BITS + _lowestSetBit(bits);
+				gx = rect.left + x;
+				OwnTile& tile = _writableTile(gx / SPRITEX_TILE_SIZE, gy / SPRITEX_TILE_SIZE);
+				k = (gy % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE + gx % SPRITEX_TILE_SIZE;
+				if (density != NULL) density[y * rect.width + x] = tile.maps.density[k];
+				tile.maps.density[k] = 0;
+				tile.maps.mask[gy % SPRITEX_TILE_SIZE] &= ~(static_cast<uint64_t>(1) << (gx % SPRITEX_TILE_SIZE));
+				if (tile.pixels.empty()) continue;
+				if (pixels != NULL) memcpy(&pixels[(y * rect.width + x) * 4], &tile.pixels[k * 4], 4);
+				memset(&tile.pixels[k * 4], 0, 4);
+			};
+	};
+	_updateTiles(rect);
+	_markMaskDamage(rect);
+	if (_dbgTexturesReady)
+	{
+		_markDbgDirty(rect.left, rect.top);
+		_markDbgDirty(rect.left + rect.width - 1, rect.top + rect.height - 1);
+	};
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int Spritex::_explodeSpan(OwnTile& tile, int y, int x0, int x1)
+{
+	uint8_t* density = &tile.maps.density[y * SPRITEX_TILE_SIZE];
+	bool rgba = !tile.pixels.empty();
+	sf::Uint8* pixels = rgba ? &tile.pixels[y * SPRITEX_TILE_SIZE * 4] : NULL;
+	uint64_t& mask = tile.maps.mask[y];
+	int destroyed = 0;
+	int x = x0;
+#ifdef SPRITEX_SSE2
+	// 16 pixels per step: decrease densities (saturated at 0), then clear RGBA (4 pixels per register) and 16 mask bits of pixels, which had density 1.
+	// Tile row is one mask word, so the bits never cross words
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i d, hit, lo, hi, lanes[4];
+	__m128i* p;
+	int bits;
+	for (; x + 16 <= x1 + 1; x += 16)
+	{
+		d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(density + x));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(density + x), _mm_subs_epu8(d, one));
+		hit = _mm_cmpeq_epi8(d, one);
+		bits = _mm_movemask_epi8(hit);
+		if (bits == 0) continue;
+		// Widen byte lanes to pixel lanes
+		lo = _mm_unpacklo_epi8(hit, hit);
+		hi = _mm_unpackhi_epi8(hit, hit);
+		lanes[0] = _mm_unpacklo_epi16(lo, lo);
+		lanes[1] = _mm_unpackhi_epi16(lo, lo);
+		lanes[2] = _mm_unpacklo_epi16(hi, hi);
+		lanes[3] = _mm_unpackhi_epi16(hi, hi);
+		for (int k = 0; (k < 4) && rgba; k++)
+		{
+			p = reinterpret_cast<__m128i*>(pixels + (x + k * 4) * 4);
+			_mm_storeu_si128(p, _mm_andnot_si128(lanes[k], _mm_loadu_si128(p)));
+		};
+		mask &= ~(static_cast<uint64_t>(bits) << x);
+		destroyed += _bitCount(bits);
+	};
+#endif
+	for (; x <= x1; x++)
+	{
+		if (density[x] == 0) continue;
+		if (--density[x] != 0) continue;
+		if (rgba) memset(pixels + x * 4, 0, 4);
+		mask &= ~(static_cast<uint64_t>(1) << x);
+		destroyed++;
+	};
+	return destroyed;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -135,57 +400,229 @@ bool Spritex::collides(Spritex& second, bool pp, bool remove, sf::Vector2f* coll
 	{ // second sprite is smaller, it is cheaper to call its 'collide' method
 		return second.collides(*this, pp, remove, collisionPoint);
 	};
-	sf::Transform secondReverseTransform = second.getInverseTransform();
-	sf::Transform secondTransform = second.getTransform();
-	sf::Transform reverseTransform = getInverseTransform();
-	sf::Transform transform = getTransform();
-	int alpha, otherAlpha;
+	if (isTranslationOnly() && second.isTranslationOnly()) return _collidesTranslated(second, remove, collisionPoint);
+	return _collidesTransformed(second, remove, collisionPoint);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Spritex::_collidesTranslated(Spritex& second, bool remove, sf::Vector2f* collisionPoint)
+{
+	// Pixel (x, y) of this spritex lies over pixel (x + shiftX, y + shiftY) of the second one
+	sf::Vector2f offset = getTransform().transformPoint(0, 0) - second.getTransform().transformPoint(0, 0);
+	int shiftX = static_cast<int>(floor(offset.x));
+	int shiftY = static_cast<int>(floor(offset.y));
+	int sx = _size.x;
+	int sy = _size.y;
+	int otherSx = second._size.x;
+	int otherSy = second._size.y;
+	// Overlapping rows and mask words of this spritex
+	int minY = std::max(0, -shiftY);
+	int maxY = std::min(sy, otherSy - shiftY);
+	int minX = std::max(0, -shiftX);
+	int maxX = std::min(sx, otherSx - shiftX);
+	if ((minY >= maxY) || (minX >= maxX)) return false;
+	int minWord = minX / MASK_WORD_BITS;
+	int maxWord = (maxX - 1) / MASK_WORD_BITS;
+	uint64_t word, hit;
+	int x, bandEnd;
+	for (int y = minY; y < maxY; y = bandEnd)
+	{
+		// Rows lying over the same row of tiles of the second spritex are skipped at once, if these tiles are empty
+		bandEnd = std::min(maxY, ((y + shiftY) / SPRITEX_TILE_SIZE + 1) * SPRITEX_TILE_SIZE - shiftY);
+		if (second._tileSpanState(minX + shiftX, maxX + shiftX, y + shiftY) == TILE_EMPTY) continue;
+		for (; y < bandEnd; y++)
+		{
+			for (int w = minWord; w <= maxWord; w++)
+			{
+				word = _maskWord(w, y);
+				if (word == 0) continue; // skip transparent pixels
+				hit = word & second._maskBitsAt(w * MASK_WORD_BITS + shiftX, y + shiftY);
+				if (hit == 0) continue;
+				if (!remove)
+				{
+					if (collisionPoint != NULL)
+					{
+						x = w * MASK_WORD_BITS + _lowestSetBit(hit);
+						*collisionPoint = getTransform().transformPoint(static_cast<float>(x), static_cast<float>(y));
+					};
+					return true;
+				};
+				while (hit != 0)
+				{
+					x = w * MASK_WORD_BITS + _lowestSetBit(hit);
+					second.destroyPixel(x + shiftX, y + shiftY);
+					hit &= hit - 1; // clear lowest set bit
+				};
+			};
+		};
+	};
+	return false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Spritex::collidesAt(const sf::Vector2f& position, const Spritex& second) const
+{
+	// Transforms are taken from copies: SFML updates cached transform on first use, and other threads may read the same spritexes
+	sf::Transformable moved(*this);
+	sf::Transformable other(second);
+	moved.setPosition(position);
+	sf::Transform thisTransform = moved.getTransform();
+	sf::Transform thatTransform = other.getTransform();
+	sf::Vector2f size = getSize();
+	sf::Vector2f otherSize = second.getSize();
+
+	if (!thisTransform.transformRect(getAABB()).intersects(thatTransform.transformRect(second.getAABB()))) return false;
+	// Smaller spritex runs the test, as in 'collides'
+	if ((size.x * size.y) > (otherSize.x * otherSize.y)) return second._overlapsTranslated(*this, thatTransform.transformPoint(0, 0) - thisTransform.transformPoint(0, 0));
+	return _overlapsTranslated(second, thisTransform.transformPoint(0, 0) - thatTransform.transformPoint(0, 0));
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Spritex::_overlapsTranslated(const Spritex& second, const sf::Vector2f& offset) const
+{
+	// Pixel (x, y) of this spritex lies over pixel (x + shiftX, y + shiftY) of the second one, as in '_collidesTranslated'
+	int shiftX = static_cast<int>(floor(offset.x));
+	int shiftY = static_cast<int>(floor(offset.y));
+	int minY = std::max(0, -shiftY);
+	int maxY = std::min(static_cast<int>(_size.y), static_cast<int>(second._size.y) - shiftY);
+	int minX = std::max(0, -shiftX);
+	int maxX = std::min(static_cast<int>(_size.x), static_cast<int>(second._size.x) - shiftX);
+	if ((minY >= maxY) || (minX >= maxX)) return false;
+	int minWord = minX / MASK_WORD_BITS;
+	int maxWord = (maxX - 1) / MASK_WORD_BITS;
+	uint64_t word;
+	int state, bandEnd;
+	for (int y = minY; y < maxY; y = bandEnd)
+	{
+		// Rows lying over the same row of tiles of the second spritex, as in '_collidesTranslated'
+		bandEnd = std::min(maxY, ((y + shiftY) / SPRITEX_TILE_SIZE + 1) * SPRITEX_TILE_SIZE - shiftY);
+		state = second._tileSpanState(minX + shiftX, maxX + shiftX, y + shiftY);
+		if (state == TILE_EMPTY) continue;
+		for (; y < bandEnd; y++)
+		{
+			for (int w = minWord; w <= maxWord; w++)
+			{
+				word = _maskWord(w, y);
+				if (word == 0) continue;
+				if (state == TILE_FULL)
+				{ // all pixels under overlapping columns are solid
+					if ((word & _columnBits(w, minX, maxX)) != 0) return true;
+				}
+				else if ((word & second._maskBitsAt(w * MASK_WORD_BITS + shiftX, y + shiftY)) != 0) return true;
+			};
+		};
+	};
+	return false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Spritex::_collidesTransformed(Spritex& second, bool remove, sf::Vector2f* collisionPoint)
+{
+	sf::Vector2f otherSize = second.getSize();
+	int sx = _size.x;
+	int sy = _size.y;
+	// Transform from this local coords to the second local coords
+	sf::Transform toSecond = second.getInverseTransform() * getTransform();
 	sf::Vector2f curPoint;
-	for (int y = 0; y < size.y; y++)
+	for (int y = 0; y < sy; y++)
 	{
-		for (int x = 0; x < size.x; x++)
+		for (int x = 0; x < sx; x++)
 		{
-			alpha = _densityMap.getPixel(x, y).a;
-			if (alpha == 0) continue; // skip transparent pixels
-			curPoint = getTransform().transformPoint(sf::Vector2f(static_cast<float>(x), static_cast<float>(y))); // x,y to global coords
-			curPoint = secondReverseTransform.transformPoint(curPoint); // from global coords to second local coords
+			if (!_maskAt(x, y)) continue; // skip transparent pixels
+			curPoint = toSecond.transformPoint(static_cast<float>(x), static_cast<float>(y));
 			if ((curPoint.x < 0) || (curPoint.y < 0) || (curPoint.x > otherSize.x - 1) || (curPoint.y > otherSize.y - 1)) continue; // out of range
-			otherAlpha = second._densityMap.getPixel(static_cast<int>(curPoint.x), static_cast<int>(curPoint.y)).a;
-			if (otherAlpha != 0)
+			if (second._maskAt(static_cast<int>(curPoint.x), static_cast<int>(curPoint.y)))
 			{
 				if (remove)
 				{
-					second.setPixel(static_cast<int>(curPoint.x), static_cast<int>(curPoint.y), sf::Color::Transparent);
-					second._densityMap.setPixel(static_cast<int>(curPoint.x), static_cast<int>(curPoint.y), sf::Color::Transparent);
+					second.destroyPixel(static_cast<int>(curPoint.x), static_cast<int>(curPoint.y));
 				}
 				else
 				{
 					if (collisionPoint != NULL)
 					{
-						collisionPoint->x = static_cast<float>(x);
-						collisionPoint->y = static_cast<float>(y);
-						*collisionPoint = transform.transformPoint(*collisionPoint);
+						*collisionPoint = getTransform().transformPoint(static_cast<float>(x), static_cast<float>(y));
 					};
 					return true;
 				};
 			};
 		};
 	};
-	if (remove) second._prepareDbgAlphaTexture();
 	return false;
 };
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int Spritex::overlap(Spritex& second, sf::Vector2f* sum)
+{
+	int sx = _size.x;
+	int sy = _size.y;
+	int count = 0;
+	sf::Vector2f local(0, 0);
+	sf::Vector2f p;
+
+	if (!_AABBIntersection(second)) return 0;
+	if (isTranslationOnly() && second.isTranslationOnly())
+	{ // Word-parallel, as in '_collidesTranslated'
+		sf::Vector2f offset = getTransform().transformPoint(0, 0) - second.getTransform().transformPoint(0, 0);
+		int shiftX = static_cast<int>(floor(offset.x));
+		int shiftY = static_cast<int>(floor(offset.y));
+		int minY = std::max(0, -shiftY);
+		int maxY = std::min(sy, static_cast<int>(second._size.y) - shiftY);
+		uint64_t word, hit;
+		int bandEnd;
+		for (int y = minY; y < maxY; y = bandEnd)
+		{
+			bandEnd = std::min(maxY, ((y + shiftY) / SPRITEX_TILE_SIZE + 1) * SPRITEX_TILE_SIZE - shiftY);
+			if (second._tileSpanState(shiftX, shiftX + sx, y + shiftY) == TILE_EMPTY) continue;
+			for (; y < bandEnd; y++)
+			{
+				for (int w = 0; w < _tileColumns; w++)
+				{
+					word = _maskWord(w, y);
+					if (word == 0) continue;
+					hit = word & second._maskBitsAt(w * MASK_WORD_BITS + shiftX, y + shiftY);
+					for (; hit != 0; hit &= hit - 1)
+					{
+						local += sf::Vector2f(static_cast<float>(w * MASK_WORD_BITS + _lowestSetBit(hit)), static_cast<float>(y));
+						count++;
+					};
+				};
+			};
+		};
+	}
+	else
+	{
+		sf::Transform toSecond = second.getInverseTransform() * getTransform();
+		for (int y = 0; y < sy; y++)
+			for (int x = 0; x < sx; x++)
+			{
+				if (!_maskAt(x, y)) continue;
+				p = toSecond.transformPoint(static_cast<float>(x), static_cast<float>(y));
+				if ((p.x < 0) || (p.y < 0) || (p.x >= second.getSize().x) || (p.y >= second.getSize().y)) continue;
+				if (!second._maskAt(static_cast<int>(p.x), static_cast<int>(p.y))) continue;
+				local += sf::Vector2f(static_cast<float>(x), static_cast<float>(y));
+				count++;
+			};
+	};
+	if ((count != 0) && (sum != NULL))
+	{ // sum of transformed points is transform of the sum scaled by count, plus translation for each point
+		local += sf::Vector2f(0.5f, 0.5f) * static_cast<float>(count);
+		*sum += getTransform().transformPoint(local / static_cast<float>(count)) * static_cast<float>(count);
+	};
+	return count;
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Spritex::dbgDrawDensityMap(sf::RenderTarget& target, sf::Vector2f position)
 {
-	sf::Texture tTexture;
-	tTexture.loadFromImage(_densityMap);
-	_drawTextureAndAABB(target, position, tTexture);
+	_updateDbgTextures();
+	_drawTextureAndAABB(target, position, _dbgDensityTexture);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void Spritex::dbgDrawAlphaMap(sf::RenderTarget& target, sf::Vector2f position)
 {
+	_updateDbgTextures();
 	_drawTextureAndAABB(target, position, _dbgAlphaTexture);
 };
 
@@ -203,7 +640,7 @@ void Spritex::_drawTextureAndAABB(sf::RenderTarget& target, const sf::Vector2f&
 void Spritex::_drawAABB(sf::RenderTarget& target, const sf::Vector2f& position)
 {
 	sf::VertexArray AABB;
-	sf::FloatRect boundingBox = _sprite.getGlobalBounds();
+	sf::FloatRect boundingBox = getAABB();
 	AABB.append(sf::Vertex(sf::Vector2f(boundingBox.left, boundingBox.top), sf::Color::Blue));
 	AABB.append(sf::Vertex(sf::Vector2f(boundingBox.left + boundingBox.width, boundingBox.top), sf::Color::Blue));
 	AABB.append(sf::Vertex(sf::Vector2f(boundingBox.left + boundingBox.width, boundingBox.top + boundingBox.height), sf::Color::Blue));
@@ -215,23 +652,228 @@ void Spritex::_drawAABB(sf::RenderTarget& target, const sf::Vector2f& position)
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Spritex::_prepareDbgAlphaTexture()
+void Spritex::_updateDbgTextures()
 {
-	// Represent alpha channel as grayscale image (r=g=b=(255-a))
-	sf::Image tImage;
-	sf::Color tColor;
-	int sx = _densityMap.getSize().x;
-	int sy = _densityMap.getSize().y;
-	int c;
-	tImage.create(sx, sy, sf::Color::Transparent);
-	for (int y = 0; y < sy; y++)
-		for (int x = 0; x < sx; x++)
+	int sx = _size.x;
+	int sy = _size.y;
+	if (!_dbgTexturesReady)
+	{
+		_dbgAlphaTexture.create(sx, sy);
+		_dbgDensityTexture.create(sx, sy);
+		_dbgDirtyRect = sf::IntRect(0, 0, sx, sy);
+		_dbgDirty = true;
+		_dbgTexturesReady = true;
+	};
+	if (!_dbgDirty) return;
+	// RGBA exists only here: density is shown as gray (r=g=b=density) solid pixels, collision mask as black (solid) and white (transparent) pixels
+	const sf::IntRect& r = _dbgDirtyRect;
+	std::vector<sf::Uint8> density(r.width * r.height * 4);
+	std::vector<sf::Uint8> alpha(r.width * r.height * 4);
+	sf::Uint8 d, c;
+	bool solid;
+	for (int y = 0; y < r.height; y++)
+		for (int x = 0; x < r.width; x++)
+		{
+			solid = _maskAt(r.left + x, r.top + y);
+			d = getDensityAt(r.left + x, r.top + y);
+			c = solid ? 0 : 255;
+			sf::Uint8* dp = &density[(y * r.width + x) * 4];
+			sf::Uint8* ap = &alpha[(y * r.width + x) * 4];
+			dp[0] = dp[1] = dp[2] = d;
+			dp[3] = solid ? 255 : 0;
+			ap[0] = ap[1] = ap[2] = c;
+			ap[3] = 255;
+		};
+	_dbgDensityTexture.update(&density[0], r.width, r.height, r.left, r.top);
+	_dbgAlphaTexture.update(&alpha[0], r.width, r.height, r.left, r.top);
+	_dbgDirty = false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::_markDbgDirty(int x, int y)
+{
+	_dbgDirtyRect = _dbgDirty ? _unionRect(_dbgDirtyRect, sf::IntRect(x, y, 1, 1)) : sf::IntRect(x, y, 1, 1);
+	_dbgDirty = true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+sf::IntRect Spritex::_unionRect(const sf::IntRect& a, const sf::IntRect& b)
+{
+	int left = std::min(a.left, b.left);
+	int top = std::min(a.top, b.top);
+	int right = std::max(a.left + a.width, b.left + b.width);
+	int bottom = std::max(a.top + a.height, b.top + b.height);
+	return sf::IntRect(left, top, right - left, bottom - top);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Spritex::_preparePages()
+{
+	sf::Vector2u pageSize;
+	std::vector<sf::Uint8> buffer;
+	int sx = _size.x;
+	int sy = _size.y;
+	int pageRows, left, top, width, height;
+
+	if (!_pages.empty()) return true;
+	if (_headless) return false;
+	// Made once, on the first damage. Most spritexes are never damaged and don't need it. Asset texture stays pristine, damage goes to own pages
+	_sourcePixels = _asset->getPixels();
+	if (_sourcePixels == NULL)
+	{ // asset doesn't keep pixels, as it isn't destructible, so they are read back from the texture
+		_readBack = _asset->texture.copyToImage();
+		_sourcePixels = _readBack.getPixelsPtr();
+	};
+	_pageColumns = (_tileColumns + SPRITEX_PAGE_TILES - 1) / SPRITEX_PAGE_TILES;
+	pageRows = (_tileRows + SPRITEX_PAGE_TILES - 1) / SPRITEX_PAGE_TILES;
+	_pages.resize(_pageColumns * pageRows);
+	for (int py = 0; py < pageRows; py++)
+		for (int px = 0; px < _pageColumns; px++)
+		{
+			// Page is a whole number of tiles, pixels out of the image are transparent
+			left = px * SPRITEX_PAGE_TILES * SPRITEX_TILE_SIZE;
+			top = py * SPRITEX_PAGE_TILES * SPRITEX_TILE_SIZE;
+			pageSize.x = std::min(SPRITEX_PAGE_TILES, _tileColumns - px * SPRITEX_PAGE_TILES) * SPRITEX_TILE_SIZE;
+			pageSize.y = std::min(SPRITEX_PAGE_TILES, _tileRows - py * SPRITEX_PAGE_TILES) * SPRITEX_TILE_SIZE;
+			width = std::min(static_cast<int>(pageSize.x), sx - left);
+			height = std::min(static_cast<int>(pageSize.y), sy - top);
+			buffer.assign(pageSize.x * pageSize.y * 4, 0);
+			for (int y = 0; y < height; y++) memcpy(&buffer[y * pageSize.x * 4], &_sourcePixels[((top + y) * sx + left) * 4], width * 4);
+			sf::Texture& page = _pages[py * _pageColumns + px];
+			if (!page.create(pageSize.x, pageSize.y)) throw "Error creating texture";
+			page.update(buffer.data());
+		};
+	_buildQuads();
+	return true;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::_buildQuads()
+{
+	sf::Vector2i tileSize;
+	sf::Vector2f pos, tex;
+
+	_pageQuads.assign(_pages.size(), sf::VertexArray(sf::Quads));
+	for (int ty = 0; ty < _tileRows; ty++)
+		for (int tx = 0; tx < _tileColumns; tx++)
+		{
+			if (_tileAt(tx, ty)->state == TILE_EMPTY) continue;
+			// Quad covers the part of tile inside the image
+			tileSize = _asset->getTileSize(tx, ty);
+			pos = sf::Vector2f(static_cast<float>(tx * SPRITEX_TILE_SIZE), static_cast<float>(ty * SPRITEX_TILE_SIZE));
+			tex = sf::Vector2f(static_cast<float>((tx % SPRITEX_PAGE_TILES) * SPRITEX_TILE_SIZE), static_cast<float>((ty % SPRITEX_PAGE_TILES) * SPRITEX_TILE_SIZE));
+			sf::VertexArray& quads = _pageQuads[(ty / SPRITEX_PAGE_TILES) * _pageColumns + tx / SPRITEX_PAGE_TILES];
+			quads.append(sf::Vertex(pos, tex));
+			quads.append(sf::Vertex(pos + sf::Vector2f(static_cast<float>(tileSize.x), 0), tex + sf::Vector2f(static_cast<float>(tileSize.x), 0)));
+			quads.append(sf::Vertex(pos + sf::Vector2f(static_cast<float>(tileSize.x), static_cast<float>(tileSize.y)),
+				tex + sf::Vector2f(static_cast<float>(tileSize.x), static_cast<float>(tileSize.y))));
+			quads.append(sf::Vertex(pos + sf::Vector2f(0, static_cast<float>(tileSize.y)), tex + sf::Vector2f(0, static_cast<float>(tileSize.y))));
+		};
+	_quadsDirty = false;
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Spritex::OwnTile& Spritex::_writableTile(int tx, int ty)
+{
+	int k = ty * _tileColumns + tx;
+	sf::Vector2i tileSize;
+
+	if (_ownTile[k] != NULL) return *_ownTile[k];
+	_ownTiles.push_back(OwnTile());
+	OwnTile& tile = _ownTiles.back();
+	_ownTile[k] = &tile;
+	tile.maps = _asset->getTile(tx, ty);
+	tile.tx = tx;
+	tile.ty = ty;
+	tile.dirty = false;
+	_tileData[k] = &tile.maps;
+	if (!_preparePages()) return tile;
+	// Pixels of the tile only
+	tileSize = _asset->getTileSize(tx, ty);
+	tile.pixels.assign(SPRITEX_TILE_SIZE * SPRITEX_TILE_SIZE * 4, 0);
+	for (int y = 0; y < tileSize.y; y++)
+		memcpy(&tile.pixels[y * SPRITEX_TILE_SIZE * 4], &_sourcePixels[((ty * SPRITEX_TILE_SIZE + y) * _size.x + tx * SPRITEX_TILE_SIZE) * 4], tileSize.x * 4);
+	return tile;
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::_setMaskAt(int x, int y, bool solid)
+{
+	uint64_t bit = static_cast<uint64_t>(1) << (x % MASK_WORD_BITS);
+	SpritexTile& tile = _writableTile(x / SPRITEX_TILE_SIZE, y / SPRITEX_TILE_SIZE).maps;
+	uint64_t& word = tile.mask[y % SPRITEX_TILE_SIZE];
+	if (solid) word |= bit; else word &= ~bit;
+	tile.state = TILE_MIXED;
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Spritex::_maskBitsAt(int x, int y) const
+{
+	// Floor division, because 'x' may be negative
+	int word = (x >= 0) ? (x / MASK_WORD_BITS) : -((MASK_WORD_BITS - 1 - x) / MASK_WORD_BITS);
+	int shift = x - word * MASK_WORD_BITS;
+	uint64_t lo = ((word >= 0) && (word < _tileColumns)) ? _maskWord(word, y) : 0;
+	if (shift == 0) return lo;
+	uint64_t hi = ((word + 1 >= 0) && (word + 1 < _tileColumns)) ? _maskWord(word + 1, y) : 0;
+	return (lo >> shift) | (hi << (MASK_WORD_BITS - shift));
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int Spritex::_tileSpanState(int x0, int x1, int y) const
+{
+	bool full = (x0 >= 0) && (x1 <= static_cast<int>(_size.x));
+	const SpritexTile* const* tiles = &_tileData[(y / SPRITEX_TILE_SIZE) * _tileColumns];
+	x0 = std::max(x0, 0);
+	x1 = std::min(x1, static_cast<int>(_size.x));
+	if (x0 >= x1) return TILE_EMPTY;
+	bool empty = true;
+	for (int tx = x0 / SPRITEX_TILE_SIZE; tx <= (x1 - 1) / SPRITEX_TILE_SIZE; tx++)
+	{
+		if (tiles[tx]->state != TILE_EMPTY) empty = false;
+		if (tiles[tx]->state != TILE_FULL) full = false;
+	};
+	if (empty) return TILE_EMPTY;
+	return full ? TILE_FULL : TILE_MIXED;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Spritex::_columnBits(int w, int x0, int x1)
+{
+	int lo = std::max(x0 - w * MASK_WORD_BITS, 0);
+	int hi = std::min(x1 - w * MASK_WORD_BITS, MASK_WORD_BITS);
+	if (lo >= hi) return 0;
+	uint64_t bits = (hi == MASK_WORD_BITS) ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << hi) - 1;
+	return bits & ~((static_cast<uint64_t>(1) << lo) - 1);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Spritex::_updateTiles(const sf::IntRect& rect)
+{
+	sf::Vector2i tileSize;
+	OwnTile* own;
+
+	for (int ty = rect.top / SPRITEX_TILE_SIZE; ty <= (rect.top + rect.height - 1) / SPRITEX_TILE_SIZE; ty++)
+		for (int tx = rect.left / SPRITEX_TILE_SIZE; tx <= (rect.left + rect.width - 1) / SPRITEX_TILE_SIZE; tx++)
+		{
+			own = _ownTile[ty * _tileColumns + tx];
+			if (own == NULL) continue; // not changed
+			OwnTile& tile = *own;
+			tileSize = _asset->getTileSize(tx, ty);
+			tile.maps.summarize(tileSize.x, tileSize.y);
+			if (tile.maps.state == TILE_EMPTY) _quadsDirty = true;
+			_markTileDirty(tile);
+		};
+};
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t Spritex::getMaskHash() const
+{
+	uint64_t hash = HASH_INIT;
+	uint64_t word;
+	// Row by row, as a mask of the whole image, so hash doesn't depend on tile layout
+	for (int y = 0; y < static_cast<int>(_size.y); y++)
+		for (int w = 0; w < _tileColumns; w++)
 		{
-			tColor = _densityMap.getPixel(x, y);
-			c = 255 - tColor.a; // More transparent pixel is more lighter
-			tImage.setPixel(x, y, sf::Color(c, c, c));
+			word = _maskWord(w, y);
+			hash = hashBytes(hash, &word, sizeof(word));
 		};
-	_dbgAlphaTexture.loadFromImage(tImage);
+	return hash;
 };
 
 }; // namespace Diamondek
\ No newline at end of file
@@ -3,53 +3,69 @@
     \brief Spritex class
 
     Spritex (sprite extended) is a sprite with some additional functionality (image "density" implementation in our case).
+    Image data is a shared SpritexAsset, stored by square tiles. Density, mask and pixels of a tile are copied from it on the first change of the tile only,
+    so undamaged spritexes cost nothing and damage touches only the tiles it hits. Damaged spritex is drawn from its own texture pages, a region per tile.
 */
 
 #ifndef _SPRITEX_H_
 #define _SPRITEX_H_
 
 #include <SFML/Graphics.hpp>
+#include <deque>
+#include "assetcache.h"
 
 #define MAX_DENSITY_DEFAULT 1
 #define SPEED_POW2_THRESHOLD 0.0025f
+// Own texture of damaged spritex is split into pages of up to this number of tiles per side, so spritex may be larger than any texture
+#define SPRITEX_PAGE_TILES 16
 
 namespace Diamondek {
 
-class Spritex;
-
-typedef std::map<uint32_t, Spritex*> SpritexMap;
-typedef SpritexMap::iterator SpritexMapIterator;
-
 class Spritex : public sf::Drawable, public sf::Transformable
 {
 public:
 	/// Construct spritex from image file.
-	/// Density calculated from rgb-values of pixels, more darken pixels are more though
+	/// All pixels have density 'maxDensity' (0 - density is taken from red channel of the image)
 	Spritex(const std::string& filename, unsigned int maxDensity = MAX_DENSITY_DEFAULT);
 	/// Construct spritex from pixelmap and densitymap files
 	Spritex(const std::string& pixelmap, const std::string& densitymap);
+	/// Construct spritex from shared 'asset', e.g. taken from AssetCache
+	Spritex(const SpritexAssetPtr& asset);
 	~Spritex(void);
+	/// In headless mode spritexes, created after this call, have no textures and are never drawn. Used to run simulation without a window
+	static void setHeadless(bool headless) { _headless = headless; };
+	static bool isHeadless() { return _headless; };
 	//
 	// Basic visual & density manipulations
 	//
 	virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
-	const sf::Vector2f getSize() const { return sf::Vector2f(_sprite.getLocalBounds().width, _sprite.getLocalBounds().height); };
-	const sf::FloatRect getAABB() const { return _sprite.getGlobalBounds(); };
-	int getDensityAt(int x, int y) { return _densityMap.getPixel(x, y).r; };
-	void setDensityAt(int x, int y, int density, int alpha) { _densityMap.setPixel(x, y, sf::Color(density, density, density, alpha)); };
-	void setPixel(int x, int y, sf::Color c) { unsigned char pixel[4] = {c.r, c.g, c.b, c.a}; _texture.update(pixel, 1, 1, x, y); };
-	//
-	// Trivial physics
-	// It's assumed that a physic tick has fixed dt
-	//
-	/// Apply permanent force to spritex
-	void applyForce(sf::Vector2f force) { _accel += force; };
-	/// Apply force only for one tick
-	void applyImpulseOfForce(sf::Vector2f force);
-	/// Calculate and move spritex to the new position according to current speed and applied forces
-	void physicsTick();
-	void setSpeed(const sf::Vector2f& speed) { if (_dynamic) _speed = speed; };
-	const sf::Vector2f& getSpeed() const { return _speed; };
+	const sf::Vector2f getSize() const { return sf::Vector2f(static_cast<float>(_size.x), static_cast<float>(_size.y)); };
+	const sf::FloatRect getAABB() const { return sf::FloatRect(0, 0, getSize().x, getSize().y); };
+	/// Return AABB in global coordinates
+	const sf::FloatRect getGlobalAABB() const { return getTransform().transformRect(getAABB()); };
+	int getDensityAt(int x, int y) const { return _tileAt(x / SPRITEX_TILE_SIZE, y / SPRITEX_TILE_SIZE)->density[(y % SPRITEX_TILE_SIZE) * SPRITEX_TILE_SIZE + x % SPRITEX_TILE_SIZE]; };
+	/// Set density of pixel, it collides if 'alpha' is not 0
+	void setDensityAt(int x, int y, int density, int alpha);
+	/// Change pixel color. Change is visible after the next 'flushDamage' call
+	void setPixel(int x, int y, sf::Color c);
+	/// Make pixel transparent and remove it from density and collision maps. Change is visible after the next 'flushDamage' call
+	void destroyPixel(int x, int y);
+	/// Upload all tiles changed since the last call to texture pages, one update per tile
+	void flushDamage();
+	/// Explosion with epicentre 'center' (local coordinates) hits pixels not further than 'radius' from it.
+	/// Density of hit pixels decreases by one, pixels with zero density left are destroyed.
+	/// Return number of destroyed pixels. Changes are visible after the next 'flushDamage' call
+	int explode(const sf::Vector2f& center, float radius);
+	/// Return true and bounds (local coordinates) of collision mask changes made since the last 'takeMaskDamage' call in 'rect', or false if mask wasn't changed
+	bool getMaskDamage(sf::IntRect& rect) const { rect = _maskDamage; return _maskDamaged; };
+	/// The same as 'getMaskDamage', and start tracking changes anew
+	bool takeMaskDamage(sf::IntRect& rect);
+	/// Move pixels of 'rect' (local coordinates) selected by 'selection' to a new asset of the size of 'rect', and destroy them here. Return the asset,
+	/// its texture is not created. 'selection' has one bit per pixel of 'rect', rows padded to MASK_WORD_BITS, only solid pixels may be selected.
+	/// Changes of this spritex are visible after the next 'flushDamage' call
+	std::shared_ptr<SpritexAsset> cut(const sf::IntRect& rect, const std::vector<uint64_t>& selection);
+	/// Destroy pixels of 'rect' selected by 'selection', as 'cut' does, without making an asset of them
+	void erase(const sf::IntRect& rect, const std::vector<uint64_t>& selection);
 	//
 	// Collision detection
 	//
@@ -58,17 +74,26 @@ public:
 	/// If 'remove' is true, then colliding pixels of second spritex are removed to eliminate collision. Note, that 'pp' must be true for remove to work
 	/// Warning! Because of the fact, that in the pair of given spritexes actually works method of a smaller spritex, remove will always affect a larger one
 	bool collides(Spritex& second, bool pp, bool remove, sf::Vector2f* collisionPoint);
-	//
-	// Actually, these methods are out of place and must be in the other class
-	//
-	void setDead() { _dead = true; };
-	bool isDead() const { return _dead; };
-	bool isDynamic() const { return _dynamic; };
-	bool isDynamic(bool v) { _dynamic = v; return _dynamic; };
-	bool isDestructible() const { return _destructible; };
-	bool isDestructible(bool v) { _destructible = v; return _destructible; };
-	bool isDiamond() const { return _diamond; };
-	bool isDiamond(bool v) { _diamond = v; return _diamond; };
+	/// Return true if this spritex would collide with 'second' (pixel perfect), if it was moved to 'position'. The same as moving it and calling 'collides',
+	/// but nothing is changed, so it may be called by several threads at once. Both spritexes must be only translated
+	bool collidesAt(const sf::Vector2f& position, const Spritex& second) const;
+	/// Return number of solid pixels of this spritex, which overlap solid pixels of 'second'.
+	/// If 'sum' is not NULL, global coordinates of centres of these pixels are added to it
+	int overlap(Spritex& second, sf::Vector2f* sum);
+	/// Return true if spritex is only translated (no rotation, no scale), so its pixels map 1:1 to global pixels
+	bool isTranslationOnly() const { return (getRotation() == 0) && (getScale() == sf::Vector2f(1, 1)); };
+	/// Return hash of collision mask, i.e. of destruction state
+	uint64_t getMaskHash() const;
+	/// Return word 'w' of collision mask row 'y', i.e. pixels w * MASK_WORD_BITS.. of the row (1 - solid)
+	uint64_t getMaskWord(int w, int y) const { return _maskWord(w, y); };
+	/// Return number of mask words in a row
+	int getMaskStride() const { return _tileColumns; };
+	/// Return shared image data
+	const SpritexAssetPtr& getAsset() const { return _asset; };
+	/// Return true if spritex draws asset texture, i.e. its pixels were never changed
+	bool isTexturePristine() const { return _pages.empty(); };
+	/// Return true if spritex has its own copy of some asset tiles, i.e. it was damaged
+	bool isDamaged() const { return !_ownTiles.empty(); };
 	//
 	// For debug purposes
 	//
@@ -78,40 +103,115 @@ public:
 	void dbgDrawAlphaMap(sf::RenderTarget& target, sf::Vector2f position);
 
 private:
-	/// Spritex speed
-	sf::Vector2f _speed;
-	/// Spritex acceleration (sum of applied forces)
-	sf::Vector2f _accel;
-	/// This bitmap is used for collision detection and "density" operations
-	/// Alpha channel of this image is used for collision detection. 0 - transparent pixel (no collision), any other value collides
-	/// R = G = B and are used for "density"
-	sf::Image _densityMap;
-	/// Sprite contain texture correcponding to '_texture' and other 'Sprite' stuff
+	/// Own copy of asset tile, made on its first change
+	class OwnTile {
+	public:
+		SpritexTile maps;
+		/// RGBA pixels, SPRITEX_TILE_SIZE rows of SPRITEX_TILE_SIZE pixels. Empty if spritex has no texture pages (headless mode)
+		std::vector<sf::Uint8> pixels;
+		/// Tile column and row
+		int tx, ty;
+		/// True if 'pixels' were changed since they were uploaded to texture page
+		bool dirty;
+	};
+	/// True if textures are not used
+	static bool _headless;
+	/// Shared pristine image data
+	SpritexAssetPtr _asset;
+	/// Size in pixels
+	sf::Vector2u _size;
+	/// Number of tiles in a row and in a column
+	int _tileColumns, _tileRows;
+	/// Tiles, row by row: own copy of a tile if it was changed, otherwise asset tile.
+	/// Single pixel changes only turn their tile into TILE_MIXED, which is always safe; 'explode' and 'cut' summarize damaged tiles exactly
+	std::vector<const SpritexTile*> _tileData;
+	/// Own copy of each tile, or NULL
+	std::vector<OwnTile*> _ownTile;
+	/// Own copies of changed tiles. Deque keeps them in place, so '_tileData', '_ownTile' and '_dirtyTiles' may point to them
+	std::deque<OwnTile> _ownTiles;
+	/// Sprite contain asset texture and other 'Sprite' stuff
 	sf::Sprite _sprite;
-	/// This texture object contain main texture of the 'Spritex'
-	sf::Texture _texture;
+	/// Own texture pages of the 'Spritex', created on the first change of pixels (or at once, if asset has no texture). Until then asset texture is drawn.
+	/// Page holds square of up to SPRITEX_PAGE_TILES tiles per side, pages are row by row, '_pageColumns' in a row
+	std::vector<sf::Texture> _pages;
+	int _pageColumns;
+	/// Quads of tiles, which are not empty, by page
+	std::vector<sf::VertexArray> _pageQuads;
+	/// True if a tile became empty since '_pageQuads' were built
+	bool _quadsDirty;
+	/// Pristine RGBA pixels, which tiles are copied from: kept asset pixels or '_readBack'
+	const sf::Uint8* _sourcePixels;
+	/// Pixels read back from asset texture, if asset doesn't keep them
+	sf::Image _readBack;
+	/// Own tiles, which pixels were changed since the last 'flushDamage' call
+	std::vector<OwnTile*> _dirtyTiles;
+	/// Scratch list of 'explode' circle rows: first and last column (x, y), number of destroyed pixels (z)
+	std::vector<sf::Vector3i> _spans;
 	/// This texture object is used for 'dbgDrawAlphaMap' method
 	sf::Texture _dbgAlphaTexture;
+	/// This texture object is used for 'dbgDrawDensityMap' method
+	sf::Texture _dbgDensityTexture;
+	/// Debug textures are built on the first debug draw only
+	bool _dbgTexturesReady;
+	/// True if '_dbgDirtyRect' of density or mask changed since debug textures were updated
+	bool _dbgDirty;
+	sf::IntRect _dbgDirtyRect;
+	/// True if collision mask was changed in '_maskDamage' since the last 'takeMaskDamage' call. Unlike '_dirtyTiles' it is tracked in headless mode too
+	bool _maskDamaged;
+	sf::IntRect _maskDamage;
 	/// return true if AABBs of this and that spritexes are intersected
 	bool _AABBIntersection(const Spritex& second);
-	/// Types of spritexes:
-	/// DYNAMIC: spritex can move, and therefore must be checked for collisions with other spritexes
-	/// STATIC: spritex doesn't move, so it's not needed to be checked for collisions
-	/// DESTRUCTABLE spritexes can be destroyed
-	/// DIAMOND: diamond object disappears, when collided with paddle, thus increasing paddle energy 
-	bool _destructible;
-	bool _dynamic;
-	bool _diamond;
-	bool _dead;
 	//
 	// Utility methods
 	//
+	/// Take shared image data from '_asset'
 	void _initDefaults();
 	void _drawTextureAndAABB(sf::RenderTarget& target, const sf::Vector2f& position, const sf::Texture& t);
-	/// Draws AABB of transformed _densityMap
+	/// Draws AABB of transformed spritex
 	void _drawAABB(sf::RenderTarget& target, const sf::Vector2f& position);
-	/// Prepare _dbgAlphaTexture for use
-	void _prepareDbgAlphaTexture();
+	/// Create debug textures if needed and update their dirty region
+	void _updateDbgTextures();
+	/// Add pixel (x, y) to the dirty region of debug textures
+	void _markDbgDirty(int x, int y);
+	/// Return bounding rectangle of 'a' and 'b'
+	static sf::IntRect _unionRect(const sf::IntRect& a, const sf::IntRect& b);
+	/// Return tile 'tx', 'ty'
+	const SpritexTile* _tileAt(int tx, int ty) const { return _tileData[ty * _tileColumns + tx]; };
+	/// Return own copy of tile 'tx', 'ty', making it before the first change
+	OwnTile& _writableTile(int tx, int ty);
+	/// Upload pixels of own 'tile' with the next 'flushDamage'
+	void _markTileDirty(OwnTile& tile) { if (tile.dirty || tile.pixels.empty()) return; tile.dirty = true; _dirtyTiles.push_back(&tile); };
+	/// Create texture pages if needed. Return false if spritex has no RGBA pixels (headless mode)
+	bool _preparePages();
+	/// Rebuild '_pageQuads'
+	void _buildQuads();
+	/// Decrease density of pixels in columns 'x0'..'x1' of row 'y' of 'tile' and destroy pixels left without density, return number of destroyed pixels
+	int _explodeSpan(OwnTile& tile, int y, int x0, int x1);
+	/// Move pixels of 'rect' selected by 'selection' to 'density' and 'pixels' of the size of 'rect' (if they are not NULL) and destroy them here
+	void _takeSelection(const sf::IntRect& rect, const std::vector<uint64_t>& selection, uint8_t* density, sf::Uint8* pixels);
+	/// Recompute summary of own tiles touching 'rect' after their mask was changed, and upload their pixels with the next 'flushDamage'
+	void _updateTiles(const sf::IntRect& rect);
+	/// Add region to '_maskDamage'
+	void _markMaskDamage(const sf::IntRect& rect) { _maskDamage = _maskDamaged ? _unionRect(_maskDamage, rect) : rect; _maskDamaged = true; };
+	/// Return mask word 'w' of row 'y'
+	uint64_t _maskWord(int w, int y) const { return _tileAt(w, y / SPRITEX_TILE_SIZE)->mask[y % SPRITEX_TILE_SIZE]; };
+	/// Return true if pixel (x, y) is solid
+	bool _maskAt(int x, int y) const { return ((_maskWord(x / MASK_WORD_BITS, y) >> (x % MASK_WORD_BITS)) & 1) != 0; };
+	/// Set or clear mask bit of pixel (x, y)
+	void _setMaskAt(int x, int y, bool solid);
+	/// Return summary of tiles covering columns 'x0'..'x1' - 1 of row 'y': TILE_EMPTY if none of them has solid pixels (columns out of spritex are empty),
+	/// TILE_FULL if all of them are full and inside spritex, otherwise TILE_MIXED
+	int _tileSpanState(int x0, int x1, int y) const;
+	/// Return bits of mask word 'w' lying in columns 'x0'..'x1' - 1
+	static uint64_t _columnBits(int w, int x0, int x1);
+	/// Return 64 mask bits of row 'y' starting from column 'x' (which may be negative or out of row). Missing bits are zero
+	uint64_t _maskBitsAt(int x, int y) const;
+	/// Word-parallel pixel perfect test for the case when both spritexes are only translated
+	bool _collidesTranslated(Spritex& second, bool remove, sf::Vector2f* collisionPoint);
+	/// Return true if solid pixels of this spritex overlap solid pixels of 'second', which is shifted by 'offset' from it. Both spritexes are only translated
+	bool _overlapsTranslated(const Spritex& second, const sf::Vector2f& offset) const;
+	/// Per-pixel test for arbitrary transforms
+	bool _collidesTransformed(Spritex& second, bool remove, sf::Vector2f* collisionPoint);
 	/// Return true if value 'v' is between 'min' and 'max'
 	//bool _between(float v, float min, float max) { return (min < v) && (v < max); };
 };
@@ -0,0 +1,86 @@
+/*!
+	\class Diamondek::ThreadPool
+    \brief ThreadPool class
+*/
+
+#include "threadpool.h"
+
+namespace Diamondek {
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPool::ThreadPool(unsigned int threads)
+{
+	_job = NULL;
+	_count = 0;
+	_next = 0;
+	_busy = 0;
+	_batch = 0;
+	_stop = false;
+	_threads = (threads == 0) ? std::thread::hardware_concurrency() : threads;
+	if (_threads == 0) _threads = 1; // unknown hardware
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	};
+	_started.notify_all();
+	for (std::vector<std::thread>::iterator t = _workers.begin(); t != _workers.end(); ++t) t->join();
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::run(int count, const std::function<void(int)>& job)
+{
+	if (count <= 0) return;
+	if ((count == 1) || (_threads < 2))
+	{
+		for (int i = 0; i < count; i++) job(i);
+		return;
+	};
+	// Lazy start, only the owner calls 'run'
+	if (_workers.empty())
+		for (unsigned int t = 1; t < _threads; t++) _workers.push_back(std::thread(&ThreadPool::_work, this));
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job = &job;
+		_count = count;
+		_next = 0;
+		_busy = static_cast<unsigned int>(_workers.size());
+		_batch++;
+	};
+	_started.notify_all();
+	_runJobs();
+	// Workers may still run their last jobs, which use 'job'
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (_busy != 0) _finished.wait(lock);
+	_job = NULL;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::_work()
+{
+	uint32_t done = 0;
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	for (;;)
+	{
+		while (!_stop && (_batch == done)) _started.wait(lock);
+		if (_stop) return;
+		done = _batch;
+		lock.unlock();
+		_runJobs();
+		lock.lock();
+		if (--_busy == 0) _finished.notify_one();
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::_runJobs()
+{
+	for (int i = _next++; i < _count; i = _next++) (*_job)(i);
+};
+
+}; // namespace Diamondek
\ No newline at end of file
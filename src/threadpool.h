@@ -0,0 +1,60 @@
+/*!
+	\class Diamondek::ThreadPool
+    \brief ThreadPool class
+
+    Fixed set of worker threads, which run one batch of jobs at a time. Workers are started by the first batch of more than one job,
+    so a pool, which is never used in parallel, costs no threads. Calling thread takes part in the batch and returns when it is done,
+    so jobs may use data of the caller. Jobs of a batch must not depend on each other or on the order they are run in.
+*/
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Diamondek {
+
+class ThreadPool
+{
+public:
+	/// Set up pool of 'threads' threads (with the calling one). If it is 0, there are as many threads as hardware runs at once
+	explicit ThreadPool(unsigned int threads = 0);
+	/// Stop workers
+	~ThreadPool();
+	/// Call 'job(i)' for each 'i' in [0, 'count') on workers and the calling thread, and return when all calls are done
+	void run(int count, const std::function<void(int)>& job);
+	/// Return number of threads running jobs, including the calling one (workers may be not started yet)
+	unsigned int getThreads() const { return _threads; };
+private:
+	/// Worker thread loop
+	void _work();
+	/// Run jobs of the current batch until there are none left
+	void _runJobs();
+	/// Number of threads, including the calling one
+	unsigned int _threads;
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	/// Signalled when a batch is started or workers are stopped
+	std::condition_variable _started;
+	/// Signalled when a worker has finished its part of a batch
+	std::condition_variable _finished;
+	/// Current batch
+	const std::function<void(int)>* _job;
+	int _count;
+	/// Next job of the batch to run
+	std::atomic<int> _next;
+	/// Number of workers still running jobs of the batch
+	unsigned int _busy;
+	/// Incremented for every batch, so workers don't run the same batch twice
+	uint32_t _batch;
+	bool _stop;
+};
+
+}; // namespace Diamondek
+
+#endif // _THREADPOOL_H_
@@ -0,0 +1,231 @@
+/*!
+    \brief Level pack compiler
+
+    Compiles levels description and all images it refers to (plus base resources: board, ball, paddle) into one binary level pack, see levelpack.h.
+    Tiles (density, collision mask and summary) are computed by Spritex asset itself, so pack matches images exactly. RGBA pixels are stored raw.
+    Build from the game sources, e.g.:
+        g++ -O2 -std=c++11 -Isrc tools/levelpack.cpp src/spritex.cpp src/levelpack.cpp src/assetcache.cpp -lsfml-graphics -lsfml-window -lsfml-system -o levelpack
+    Run from the game directory: "levelpack [levels.json] [levels.pack]" (defaults are LEVELS_FILE and LEVEL_PACK_FILE).
+    Pack is not updated automatically. Game ignores pack made of another levels.json, but it can't see changes of images: run it again after them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include "rapidjson/document.h"
+#include "globals.h"
+#include "spritex.h"
+#include "levelpack.h"
+
+namespace Diamondek {
+
+/// Image to be packed
+struct PackSource
+{
+	std::string pixelmap;
+	std::string densitymap;
+};
+
+/// Collects levels and images and writes them to pack
+class PackBuilder
+{
+public:
+	/// Read levels from 'levelsFile' and collect images of base resources and levels
+	void readLevels(const std::string& levelsFile);
+	/// Write pack to 'packFile'
+	void write(const std::string& packFile);
+private:
+	/// Return index of image made of 'pixelmap' and 'densitymap', adding it if it is new
+	uint32_t _addImage(const std::string& pixelmap, const std::string& densitymap = "");
+	/// Copy 'name' to 'dest' of 'size' bytes, throw if it doesn't fit
+	static void _copyName(char* dest, size_t size, const std::string& name);
+	/// Append zero bytes to 'data' until its size is multiple of LEVEL_PACK_ALIGN
+	static void _align(std::vector<uint8_t>& data);
+	/// Append 'size' bytes of 'src' to 'data', return offset of them
+	static uint64_t _append(std::vector<uint8_t>& data, const void* src, size_t size);
+	std::vector<PackSource> _sources;
+	std::vector<PackLevel> _levels;
+	std::vector<PackGem> _gems;
+	/// Hash of levels file, game uses pack with the same levels file only
+	uint64_t _levelsHash;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void PackBuilder::readLevels(const std::string& levelsFile)
+{
+	using namespace rapidjson;
+	Document d;
+	PackLevel level;
+	PackGem gem;
+
+	std::ifstream file(levelsFile.c_str(), std::ifstream::in);
+	if (!file.good()) throw "Error opening levels file " + levelsFile;
+	std::string s((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	file.close();
+	if (!LevelPack::hashFile(levelsFile, _levelsHash)) throw "Error reading levels file " + levelsFile;
+	d.Parse(s.c_str());
+	if (d.HasParseError() || !d.IsArray()) throw "Error parsing levels file " + levelsFile;
+	// Base resources, loaded by Board::loadResources for every level
+	_addImage(BOARD_IMAGE, BOARD_DENSITY_IMAGE);
+	_addImage(BALL_IMAGE);
+	_addImage(PADDLE_IMAGE);
+	for (SizeType l = 0; l < d.Size(); l++)
+	{
+		const Value& v = d[l];
+		memset(&level, 0, sizeof(level));
+		_copyName(level.code, sizeof(level.code), v["code"].GetString());
+		level.imageIndex = _addImage(v["image"].GetString(), v["density"].GetString());
+		level.firstGem = static_cast<uint32_t>(_gems.size());
+		level.gemCount = v["gems"].Size();
+		for (SizeType g = 0; g < v["gems"].Size(); g++)
+		{
+			memset(&gem, 0, sizeof(gem));
+			gem.x = v["gems"][g]["x"].GetInt();
+			gem.y = v["gems"][g]["y"].GetInt();
+			gem.idx = v["gems"][g]["idx"].GetInt();
+			_addImage(GEM_IMAGE_PREFIX + boost::lexical_cast<std::string>(gem.idx) + GEM_IMAGE_SUFFIX);
+			_gems.push_back(gem);
+		};
+		_levels.push_back(level);
+	};
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t PackBuilder::_addImage(const std::string& pixelmap, const std::string& densitymap)
+{
+	PackSource source;
+
+	for (uint32_t i = 0; i < _sources.size(); i++)
+		if ((_sources[i].pixelmap == pixelmap) && (_sources[i].densitymap == densitymap)) return i;
+	source.pixelmap = pixelmap;
+	source.densitymap = densitymap;
+	_sources.push_back(source);
+	return static_cast<uint32_t>(_sources.size() - 1);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void PackBuilder::write(const std::string& packFile)
+{
+	std::vector<uint8_t> data;
+	std::vector<PackImage> images(_sources.size());
+	PackHeader header;
+	sf::Image pixelImage;
+
+	// Tables are written after pixel data are laid out, reserve space for them first
+	memset(&header, 0, sizeof(header));
+	header.magic = LEVEL_PACK_MAGIC;
+	header.version = LEVEL_PACK_VERSION;
+	header.imageCount = static_cast<uint32_t>(images.size());
+	header.levelCount = static_cast<uint32_t>(_levels.size());
+	header.gemCount = static_cast<uint32_t>(_gems.size());
+	header.levelsHash = _levelsHash;
+	data.resize(sizeof(header));
+	_align(data);
+	header.imagesOffset = data.size();
+	data.resize(data.size() + images.size() * sizeof(PackImage));
+	_align(data);
+	header.levelsOffset = data.size();
+	data.resize(data.size() + _levels.size() * sizeof(PackLevel));
+	_align(data);
+	header.gemsOffset = data.size();
+	data.resize(data.size() + _gems.size() * sizeof(PackGem));
+	for (size_t i = 0; i < _sources.size(); i++)
+	{
+		const PackSource& source = _sources[i];
+		PackImage& image = images[i];
+		// Spritex is headless, it computes density and mask only
+		if (!pixelImage.loadFromFile(source.pixelmap)) throw "Error loading image " + source.pixelmap;
+		Spritex* spritex = source.densitymap.empty() ? new Spritex(source.pixelmap) : new Spritex(source.pixelmap, source.densitymap);
+		memset(&image, 0, sizeof(image));
+		_copyName(image.pixelmap, sizeof(image.pixelmap), source.pixelmap);
+		_copyName(image.densitymap, sizeof(image.densitymap), source.densitymap);
+		image.width = pixelImage.getSize().x;
+		image.height = pixelImage.getSize().y;
+		image.tileColumns = spritex->getAsset()->tileColumns;
+		image.tileRows = spritex->getAsset()->tileRows;
+		_align(data);
+		image.rgbaOffset = _append(data, pixelImage.getPixelsPtr(), image.width * image.height * 4);
+		_align(data);
+		image.tilesOffset = _append(data, spritex->getAsset()->tiles.data(), spritex->getAsset()->tiles.size() * sizeof(SpritexTile));
+		delete spritex;
+		printf("%-40s %-40s %5ux%-5u\n", source.pixelmap.c_str(), source.densitymap.c_str(), image.width, image.height);
+	};
+	header.size = data.size();
+	memcpy(&data[0], &header, sizeof(header));
+	if (!images.empty()) memcpy(&data[header.imagesOffset], &images[0], images.size() * sizeof(PackImage));
+	if (!_levels.empty()) memcpy(&data[header.levelsOffset], &_levels[0], _levels.size() * sizeof(PackLevel));
+	if (!_gems.empty()) memcpy(&data[header.gemsOffset], &_gems[0], _gems.size() * sizeof(PackGem));
+
+	std::ofstream file(packFile.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	file.write(reinterpret_cast<const char*>(&data[0]), data.size());
+	file.close();
+	if (!file.good()) throw "Error writing level pack " + packFile;
+	printf("%u levels, %u gems, %u images, %llu bytes written to %s\n", header.levelCount, header.gemCount, header.imageCount,
+		static_cast<unsigned long long>(header.size), packFile.c_str());
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void PackBuilder::_copyName(char* dest, size_t size, const std::string& name)
+{
+	// Last byte stays zero
+	if (name.size() >= size) throw "Error: name is too long for level pack: " + name;
+	memset(dest, 0, size);
+	memcpy(dest, name.c_str(), name.size());
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void PackBuilder::_align(std::vector<uint8_t>& data)
+{
+	data.resize((data.size() + LEVEL_PACK_ALIGN - 1) / LEVEL_PACK_ALIGN * LEVEL_PACK_ALIGN, 0);
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t PackBuilder::_append(std::vector<uint8_t>& data, const void* src, size_t size)
+{
+	uint64_t offset = data.size();
+	const uint8_t* bytes = static_cast<const uint8_t*>(src);
+	data.insert(data.end(), bytes, bytes + size);
+	return offset;
+};
+
+}; // namespace Diamondek
+
+int main(int argc, char* argv[])
+{
+	const uint32_t one = 1;
+	Diamondek::PackBuilder builder;
+
+	if ((argc > 3) || ((argc > 1) && (argv[1][0] == '-')))
+	{
+		fprintf(stderr, "Usage: %s [levels.json] [levels.pack]\n", argv[0]);
+		return EXIT_FAILURE;
+	};
+	// Pack is mapped as is, so it is little-endian like the game targets
+	if (*reinterpret_cast<const uint8_t*>(&one) != 1)
+	{
+		fprintf(stderr, "Error: level pack can be built on little-endian host only\n");
+		return EXIT_FAILURE;
+	};
+	Diamondek::Spritex::setHeadless(true);
+	try
+	{
+		builder.readLevels((argc > 1) ? argv[1] : LEVELS_FILE);
+		builder.write((argc > 2) ? argv[2] : LEVEL_PACK_FILE);
+	}
+	catch(const char* s)
+	{
+		fprintf(stderr, "%s\n", s);
+		return EXIT_FAILURE;
+	}
+	catch(const std::string& s)
+	{
+		fprintf(stderr, "%s\n", s.c_str());
+		return EXIT_FAILURE;
+	};
+	return EXIT_SUCCESS;
+}
\ No newline at end of file